@@ -0,0 +1,748 @@
+/*
+ * src/physics/batch.cpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include "fmm.hpp"
+#include "object.hpp"
+#include "report.hpp"
+#include "thread-pool.hpp"
+#include "trajectory.hpp"
+#include "data-loader.hpp"
+
+
+/** \file
+ *
+ * Runs simulation without displaying anything.  Reads objects from
+ * a file, simulates them for a given number of ticks as fast as
+ * possible and prints final positions and velocities of all objects
+ * followed by time it took.  Accepts the same switches selecting
+ * solver and integrator as <tt>physics</tt> does.  Instead of
+ * simulating, it can print reports comparing integrators, precision
+ * of direct sums and expansion orders of FMM so that they can be run
+ * on machines without a display.
+ */
+
+
+namespace mn {
+
+namespace physics {
+
+
+/** File to save snapshots to or NULL. */
+static const char *snapshotFile = 0;
+/** If not zero, snapshot is saved every given number of ticks. */
+static unsigned long snapshotEvery = 0;
+/** File to write trajectory to or NULL. */
+static const char *trajectoryFile = 0;
+/** Trajectory gets a frame every given number of ticks. */
+static unsigned long trajectoryEvery = 1;
+/** Quantum of positions in trajectory or zero to write doubles. */
+static double trajectoryQuantum = 0;
+/**
+ * If not zero, accelerations of the configured solver are compared
+ * with sorted sums before simulation and this is the maximal allowed
+ * relative error.
+ */
+static double maxSolverError = 0;
+/** Whether to print energy drift of each integrator. */
+static bool energyDrift = false;
+/**
+ * If not zero, time each integrator needs to simulate with energy
+ * error below this value is printed.
+ */
+static double benchmarkError = 0;
+/** Whether to compare double, mixed and float direct sums. */
+static bool precisionReport = false;
+/** Whether to print error and time of FMM with each expansion order. */
+static bool fmmReport = false;
+
+
+/**
+ * Loads objects from a data file or a snapshot.
+ * \param done location to save number of ticks simulated before to;
+ *        zero unless objects were loaded from a snapshot.
+ */
+template<class T>
+static BasicObjects<T> *load(const char *file, double dt,
+                             unsigned long &done) {
+	done = 0;
+	if (!ObjectsBase::isSnapshot(file)) {
+		return loadData<T>(file);
+	}
+
+	unsigned long long ticks;
+	double savedDt;
+	BasicObjects<T> *const objects =
+		BasicObjects<T>::loadSnapshot(file, ticks, savedDt);
+	if (objects) {
+		done = ticks;
+		if (savedDt != dt) {
+			fprintf(stderr, "warning: snapshot was simulated with ticks of "
+			        "%g\n", savedDt);
+		}
+	}
+	return objects;
+}
+
+
+/**
+ * Loads objects from a file, simulates them and prints time it took.
+ * If objects are loaded from a snapshot, simulation continues until
+ * \a ticks ticks in total are simulated.
+ * \param save whether to save snapshots in #snapshotFile and write
+ *        trajectory to #trajectoryFile.
+ * \return simulated objects or null if file could not be loaded.
+ */
+template<class T>
+static BasicObjects<T> *run(const char *file, unsigned long ticks,
+                            double dt, bool save) {
+	unsigned long done;
+	BasicObjects<T> *const objects = load<T>(file, dt, done);
+	if (!objects) {
+		return 0;
+	}
+	const unsigned long first = std::min(done, ticks);
+	TrajectoryWriter *const trajectory = save && trajectoryFile
+		? new TrajectoryWriter(trajectoryFile, dt, trajectoryQuantum) : 0;
+	if (trajectory && !trajectory->good()) {
+		delete trajectory;
+		delete objects;
+		return 0;
+	}
+	save = save && snapshotFile;
+
+
+	ThreadPool *const pool = ThreadPool::pool();
+	pool->resetStats();
+
+	/* Trees are shared so they may have been used before. */
+	unsigned long long builds, refits;
+	BasicObjects<T>::getTreeUpdates(builds, refits);
+
+	typedef std::chrono::steady_clock clock;
+	const clock::time_point start = clock::now();
+
+	if (trajectory && !(done % trajectoryEvery)) {
+		trajectory->add(*objects, done);
+	}
+	while (done < ticks) {
+		/* ticksAll() takes an unsigned count. */
+		unsigned long count = std::min(ticks - done, 1ul << 30);
+		if (save && snapshotEvery) {
+			count = std::min(count, snapshotEvery - done % snapshotEvery);
+		}
+		if (trajectory) {
+			count = std::min(count, trajectoryEvery - done % trajectoryEvery);
+		}
+		objects->ticksAll(count, dt);
+		objects->updatePointAll();
+		done += count;
+		if (save && snapshotEvery && !(done % snapshotEvery)) {
+			objects->saveSnapshot(snapshotFile, done, dt);
+		}
+		if (trajectory && !(done % trajectoryEvery)) {
+			trajectory->add(*objects, done);
+		}
+	}
+	if (save) {
+		objects->saveSnapshot(snapshotFile, done, dt);
+	}
+	ticks -= first;
+
+	const double seconds =
+		std::chrono::duration<double>(clock::now() - start).count();
+
+
+	if (first) {
+		fprintf(stderr, "resumed after %lu ticks\n", first);
+	}
+	fprintf(stderr, "%u objects, %lu ticks of %g in %.3f s "
+	        "(%.3g s per tick, %llu force evaluations)\n",
+	        objects->size(), ticks, dt, seconds,
+	        ticks ? seconds / ticks : 0.0, objects->getEvaluations());
+	if (ObjectsBase::collisions) {
+		fprintf(stderr, "%llu objects merged\n", objects->getMerges());
+	}
+	if (ObjectsBase::solver == ObjectsBase::BARNES_HUT ||
+	    ObjectsBase::solver == ObjectsBase::FMM) {
+		unsigned long long totalBuilds, totalRefits;
+		BasicObjects<T>::getTreeUpdates(totalBuilds, totalRefits);
+		fprintf(stderr, "tree built %llu times, refitted %llu times\n",
+		        totalBuilds - builds, totalRefits - refits);
+	}
+	if (pool->size() > 1) {
+		const ThreadPool::Stats &stats = pool->getStats();
+		fprintf(stderr, "%llu parallel jobs on %u threads, load imbalance "
+		        "%.1f%%, %llu ranges stolen\n", stats.runs, pool->size(),
+		        stats.imbalance() * 100, stats.steals);
+	}
+	if (objects->tracers()) {
+		fprintf(stderr, "%u tracers moved along\n", objects->tracers());
+	}
+	if (trajectory) {
+		trajectory->close();
+		fprintf(stderr, "%llu frames (%llu bytes) of trajectory written, "
+		        "waited for disk %llu times\n", trajectory->getFrames(),
+		        trajectory->getBytes(), trajectory->getStalls());
+		delete trajectory;
+	}
+
+	return objects;
+}
+
+
+/**
+ * Loads objects from a file and prints relative error of accelerations
+ * calculated by configured solver against sorted sums.  This is slow
+ * (the exact sums are calculated serially) so it is done on request
+ * only.
+ * \return whether maximal error does not exceed #maxSolverError.
+ */
+template<class T>
+static bool checkSolver(const char *file, double dt) {
+	unsigned long done;
+	BasicObjects<T> *const objects = load<T>(file, dt, done);
+	if (!objects) {
+		return false;
+	}
+
+	T max, rms;
+	objects->solverErrorAll(max, rms);
+	delete objects;
+
+	fprintf(stderr, "relative acceleration error against sorted sum: "
+	        "max = %g, rms = %g\n", (double)max, (double)rms);
+	if (!(max <= maxSolverError)) {
+		fprintf(stderr, "error exceeds %g\n", maxSolverError);
+		return false;
+	}
+	return true;
+}
+
+
+/**
+ * Loads objects from a file and prints requested reports instead of
+ * simulating them.  Reports run the given number of ticks of given
+ * length.
+ * \return program's exit code.
+ */
+template<class T>
+static int report(const char *file, unsigned ticks, double dt) {
+	unsigned long done;
+	BasicObjects<T> *const objects = load<T>(file, dt, done);
+	if (!objects) {
+		return 1;
+	}
+
+	printSolver(*objects);
+	if (energyDrift) {
+		printEnergyDrift(*objects, ticks, dt);
+	}
+	if (benchmarkError > 0) {
+		printIntegratorBenchmark(*objects, (T)(ticks * dt), (T)benchmarkError);
+	}
+	if (precisionReport) {
+		printPrecisionReport(*objects, ticks, dt);
+	}
+	if (fmmReport) {
+		printFmmReport(*objects);
+	}
+
+	delete objects;
+	return 0;
+}
+
+
+/** Returns whether two values have the same bits (or are both NaN). */
+template<class T>
+static bool same(T a, T b) {
+	return a == b ? std::signbit(a) == std::signbit(b) : a != a && b != b;
+}
+
+
+/**
+ * Returns number of objects whose name, position or velocity differ
+ * between two simulations; size difference counts as well.
+ */
+template<class T>
+static unsigned differences(const BasicObjects<T> &a,
+                            const BasicObjects<T> &b) {
+	typedef typename BasicObjects<T>::Vector Vector;
+	const unsigned n = std::min(a.size(), b.size());
+	unsigned count = std::max(a.size(), b.size()) - n;
+	for (unsigned i = 0; i < n; ++i) {
+		const Vector pa = a.getPosition(i), pb = b.getPosition(i);
+		const Vector va = a.getVelocity(i), vb = b.getVelocity(i);
+		count += a.getName(i) != b.getName(i) ||
+			!same(pa.x, pb.x) || !same(pa.y, pb.y) || !same(pa.z, pb.z) ||
+			!same(va.x, vb.x) || !same(va.y, vb.y) || !same(va.z, vb.z);
+	}
+	return count;
+}
+
+
+/**
+ * Loads objects from a file, simulates them and prints the results.
+ * \param checkThreads if not zero, simulation is run with a single
+ *        thread and then with given number of threads and results
+ *        are compared.
+ * \return program's exit code.
+ */
+template<class T>
+static int simulate(const char *file, unsigned long ticks, double dt,
+                    bool quiet, unsigned checkThreads) {
+	if (maxSolverError > 0 && !checkSolver<T>(file, dt)) {
+		return 1;
+	}
+
+	BasicObjects<T> *reference = 0;
+	if (checkThreads) {
+		ThreadPool::destroy();
+		ThreadPool::threads = 1;
+		reference = run<T>(file, ticks, dt, false);
+		if (!reference) {
+			return 1;
+		}
+		ThreadPool::destroy();
+		ThreadPool::threads = checkThreads;
+	}
+
+	BasicObjects<T> *const objects = run<T>(file, ticks, dt, true);
+	if (!objects) {
+		delete reference;
+		return 1;
+	}
+
+
+	if (!quiet) {
+		/* Enough digits to read the same values back. */
+		const int digits = std::numeric_limits<T>::max_digits10;
+		typedef typename BasicObjects<T>::Vector Vector;
+		for (unsigned i = 0, n = objects->size(); i < n; ++i) {
+			const Vector p = objects->getPosition(i);
+			const Vector v = objects->getVelocity(i);
+			printf("%s %.*Lg %.*Lg %.*Lg %.*Lg %.*Lg %.*Lg\n",
+			       objects->getName(i).c_str(),
+			       digits, (long double)p.x, digits, (long double)p.y,
+			       digits, (long double)p.z, digits, (long double)v.x,
+			       digits, (long double)v.y, digits, (long double)v.z);
+		}
+	}
+
+	int ret = 0;
+	if (reference) {
+		const unsigned count = differences(*reference, *objects);
+		if (count) {
+			fprintf(stderr, "final states with 1 and %u threads differ in "
+			        "%u objects\n", checkThreads, count);
+			ret = 1;
+		} else {
+			fprintf(stderr, "final states with 1 and %u threads are "
+			        "identical\n", checkThreads);
+		}
+	}
+
+	delete reference;
+	delete objects;
+	return ret;
+}
+
+
+}
+
+}
+
+
+int main(int argc, char** argv) {
+	static const struct option longopts[] = {
+		{ "barnes-hut",  2, 0, 'b' },
+		{ "symmetric",   0, 0, 'p' },
+		{ "fmm",         2, 0, 'f' },
+		{ "theta",       1, 0, 'T' },
+		{ "refit",       2, 0, 'u' },
+		{ "threads",     1, 0, 't' },
+		{ "simd",        2, 0, 's' },
+		{ "rsqrt",       0, 0, 'r' },
+		{ "mixed",       0, 0, 'M' },
+		{ "sum",         1, 0, 'a' },
+		{ "integrator",  1, 0, 'i' },
+		{ "collisions",  0, 0, 'C' },
+		{ "frozen-field",2, 0, 'F' },
+		{ "morton",      2, 0, 'z' },
+		{ "precision",   1, 0, 'P' },
+		{ "deterministic",0,0, 'D' },
+		{ "check-threads",1,0, 'c' },
+		{ "check-error", 2, 0, 'x' },
+		{ "snapshot",    1, 0, 'S' },
+		{ "snapshot-every",1,0, 'E' },
+		{ "trajectory",  1, 0, 'o' },
+		{ "trajectory-every",1,0, 'k' },
+		{ "quantum",     1, 0, 'Q' },
+		{ "energy-drift",0, 0, 'e' },
+		{ "benchmark",   2, 0, 'B' },
+		{ "precision-report",0,0,'R' },
+		{ "fmm-report",  0, 0, 'O' },
+		{ "quiet",       0, 0, 'q' },
+		{ "help",        0, 0, '?' },
+		{ 0, 0, 0, 0 }
+	};
+	int opt;
+	bool quiet = false;
+	char precision = 'd';
+	unsigned checkThreads = 0;
+	while ((opt = getopt_long(argc, argv, "?b::pf::T:u::t:s::rMa:i:CF::z::P:Dc:x::S:E:o:k:Q:eB::ROq", longopts, 0))!=-1){
+		switch (opt) {
+		case 'b':
+			mn::physics::Objects::solver = mn::physics::Objects::BARNES_HUT;
+			if (optarg) {
+				mn::physics::Objects::theta = atof(optarg);
+				if (!(mn::physics::Objects::theta > 0)) {
+					fprintf(stderr, "%s: invalid opening angle\n", optarg);
+					return 1;
+				}
+			}
+			break;
+		case 'p':
+			mn::physics::Objects::solver = mn::physics::Objects::SYMMETRIC;
+			break;
+		case 'f':
+			mn::physics::Objects::solver = mn::physics::Objects::FMM;
+			if (optarg) {
+				mn::physics::Objects::fmmOrder = atoi(optarg);
+				if (mn::physics::Objects::fmmOrder < 1 ||
+				    mn::physics::Objects::fmmOrder >
+				    mn::physics::Fmm<double>::maxOrder) {
+					fprintf(stderr, "%s: invalid expansion order\n", optarg);
+					return 1;
+				}
+			}
+			break;
+		case 'T':
+			mn::physics::Objects::theta = atof(optarg);
+			if (!(mn::physics::Objects::theta > 0)) {
+				fprintf(stderr, "%s: invalid opening angle\n", optarg);
+				return 1;
+			}
+			break;
+		case 'u':
+			mn::physics::Objects::refitTolerance = optarg ? atof(optarg) : 0.2;
+			if (!(mn::physics::Objects::refitTolerance > 0)) {
+				fprintf(stderr, "%s: invalid tolerance\n", optarg);
+				return 1;
+			}
+			break;
+		case 't':
+			if (!mn::physics::ThreadPool::parseThreads(optarg,
+			                       mn::physics::ThreadPool::threads)) {
+				fprintf(stderr, "%s: invalid number of threads\n", optarg);
+				return 1;
+			}
+			break;
+		case 's':
+			if (!mn::physics::kernel::parse(optarg ? optarg : "auto",
+			                                 mn::physics::Objects::isa)) {
+				fprintf(stderr, "%s: unsupported instruction set\n", optarg);
+				return 1;
+			}
+			mn::physics::Objects::useKernel = true;
+			break;
+		case 'r':
+			mn::physics::Objects::rsqrt = true;
+			break;
+		case 'M':
+			if (!mn::physics::Objects::useKernel) {
+				mn::physics::kernel::parse("auto", mn::physics::Objects::isa);
+				mn::physics::Objects::useKernel = true;
+			}
+			mn::physics::Objects::mixed = true;
+			break;
+		case 'a':
+			if (!strcmp(optarg, "sorted")) {
+				mn::physics::Objects::summation = mn::physics::Objects::SORTED;
+			} else if (!strcmp(optarg, "neumaier")) {
+				mn::physics::Objects::summation = mn::physics::Objects::NEUMAIER;
+			} else if (!strcmp(optarg, "pairwise")) {
+				mn::physics::Objects::summation = mn::physics::Objects::PAIRWISE;
+			} else {
+				fprintf(stderr, "%s: unknown summation method\n", optarg);
+				return 1;
+			}
+			break;
+		case 'i':
+			if (!mn::physics::parseIntegrator(optarg,
+			                                  mn::physics::Objects::integrator)) {
+				fprintf(stderr, "%s: unknown integrator\n", optarg);
+				return 1;
+			}
+			break;
+		case 'C':
+			mn::physics::Objects::collisions = true;
+			break;
+		case 'F':
+			mn::physics::Objects::fieldCells = optarg ? atoi(optarg) : 64;
+			if (!mn::physics::Objects::fieldCells) {
+				fprintf(stderr, "%s: invalid number of cells\n", optarg);
+				return 1;
+			}
+			break;
+		case 'z':
+			mn::physics::Objects::sortInterval = optarg ? atoi(optarg) : 100;
+			if (!mn::physics::Objects::sortInterval) {
+				fprintf(stderr, "%s: invalid number of ticks\n", optarg);
+				return 1;
+			}
+			break;
+		case 'P':
+			if (!strcmp(optarg, "float")) {
+				precision = 'f';
+			} else if (!strcmp(optarg, "double")) {
+				precision = 'd';
+			} else if (!strcmp(optarg, "long-double")) {
+				precision = 'l';
+			} else {
+				fprintf(stderr, "%s: unknown precision\n", optarg);
+				return 1;
+			}
+			break;
+		case 'D':
+			mn::physics::Objects::deterministic = true;
+			break;
+		case 'c':
+			if (!mn::physics::ThreadPool::parseThreads(optarg, checkThreads) ||
+			    checkThreads < 2) {
+				fprintf(stderr, "%s: invalid number of threads\n", optarg);
+				return 1;
+			}
+			break;
+		case 'x':
+			mn::physics::maxSolverError = optarg ? atof(optarg) : 1e-12;
+			if (!(mn::physics::maxSolverError > 0)) {
+				fprintf(stderr, "%s: invalid error\n", optarg);
+				return 1;
+			}
+			break;
+		case 'S':
+			mn::physics::snapshotFile = optarg;
+			break;
+		case 'E':
+			mn::physics::snapshotEvery = strtoul(optarg, 0, 0);
+			if (!mn::physics::snapshotEvery) {
+				fprintf(stderr, "%s: invalid number of ticks\n", optarg);
+				return 1;
+			}
+			break;
+		case 'o':
+			mn::physics::trajectoryFile = optarg;
+			break;
+		case 'k':
+			mn::physics::trajectoryEvery = strtoul(optarg, 0, 0);
+			if (!mn::physics::trajectoryEvery) {
+				fprintf(stderr, "%s: invalid number of ticks\n", optarg);
+				return 1;
+			}
+			break;
+		case 'Q':
+			mn::physics::trajectoryQuantum = atof(optarg);
+			if (!(mn::physics::trajectoryQuantum > 0)) {
+				fprintf(stderr, "%s: invalid quantum\n", optarg);
+				return 1;
+			}
+			break;
+		case 'e':
+			mn::physics::energyDrift = true;
+			break;
+		case 'B':
+			mn::physics::benchmarkError = optarg ? atof(optarg) : 1e-6;
+			if (!(mn::physics::benchmarkError > 0)) {
+				fprintf(stderr, "%s: invalid error\n", optarg);
+				return 1;
+			}
+			break;
+		case 'R':
+			mn::physics::precisionReport = true;
+			break;
+		case 'O':
+			mn::physics::fmmReport = true;
+			break;
+		case 'q':
+			quiet = true;
+			break;
+		case '?':
+			puts("usage: ./physics-batch [ <options> ] <data-file> <ticks> <dt>\n"
+				 "<options>:\n"
+				 " -b --barnes-hut[=<theta>]\n"
+				 "                     use Barnes-Hut octree with given opening\n"
+				 "                     angle (0.5 by default) to calculate forces\n"
+				 " -p --symmetric      calculate forces for each pair of objects once\n"
+				 " -f --fmm[=<order>]  use fast multipole method with expansions of\n"
+				 "                     given order, 1 to 8 (4 by default)\n"
+				 " -T --theta=<theta>  opening angle of Barnes-Hut and fast multipole\n"
+				 "                     method (0.5 by default); must be less then one\n"
+				 "                     for the latter\n"
+				 " -u --refit[=<tolerance>]\n"
+				 "                     refit tree to moved objects instead of building\n"
+				 "                     it again until it grows by given fraction\n"
+				 "                     (0.2 by default)\n"
+				 " -t --threads=<n>    number of threads calculating forces\n"
+				 "                     (number of CPUs by default)\n"
+				 " -s --simd[=<isa>]   use vectorised direct sum; <isa> is one of\n"
+				 "                     scalar, avx2, avx512 or auto (default)\n"
+				 " -r --rsqrt          use approximate reciprocal square root\n"
+				 "                     in vectorised direct sum\n"
+				 " -M --mixed          use vectorised direct sum calculating inverse\n"
+				 "                     distances in single precision\n"
+				 " -a --sum=<method>   method of summing accelerations in direct sum;\n"
+				 "                     sorted, neumaier (default) or pairwise\n"
+				 " -i --integrator=<name>\n"
+				 "                     euler (default), verlet, block or hermite\n"
+				 "                     (the last two calculate forces by direct sum)\n"
+				 " -C --collisions     merge objects which touch each other\n"
+				 " -F --frozen-field[=<cells>]\n"
+				 "                     cache field of frozen objects on a grid with\n"
+				 "                     given number of cells (64 by default)\n"
+				 " -z --morton[=<ticks>]\n"
+				 "                     sort objects by Morton code of their positions\n"
+				 "                     every given number of ticks (100 by default)\n"
+				 " -P --precision=<type>\n"
+				 "                     float, double (default) or long-double\n"
+				 " -D --deterministic  make results independent of number of threads\n"
+				 " -c --check-threads=<n>\n"
+				 "                     simulate with one and with <n> threads and fail\n"
+				 "                     unless final states are identical\n"
+				 " -x --check-error[=<max>]\n"
+				 "                     before simulating, compare accelerations with\n"
+				 "                     sorted sums and fail if relative error exceeds\n"
+				 "                     given value (1e-12 by default)\n"
+				 " -S --snapshot=<file>\n"
+				 "                     save snapshot of final state to given file;\n"
+				 "                     snapshot can be given instead of data file to\n"
+				 "                     continue simulation up to <ticks> ticks in total\n"
+				 " -E --snapshot-every=<ticks>\n"
+				 "                     save snapshot every given number of ticks too\n"
+				 " -o --trajectory=<file>\n"
+				 "                     write positions and velocities to given file\n"
+				 "                     (see trajectory.hpp for its format)\n"
+				 " -k --trajectory-every=<ticks>\n"
+				 "                     write them every given number of ticks (1 by\n"
+				 "                     default)\n"
+				 " -Q --quantum=<q>    round positions in trajectory to multiples of\n"
+				 "                     <q> and write differences compressed; by\n"
+				 "                     default doubles are written as they are\n"
+				 " -e --energy-drift   instead of simulating, print energy drift of\n"
+				 "                     each integrator after <ticks> ticks\n"
+				 " -B --benchmark[=<error>]\n"
+				 "                     instead of simulating, print time each\n"
+				 "                     integrator needs to simulate <ticks> ticks\n"
+				 "                     worth of time with energy error below given\n"
+				 "                     value (1e-6 by default)\n"
+				 " -R --precision-report\n"
+				 "                     instead of simulating, compare double, mixed\n"
+				 "                     and float direct sum over <ticks> ticks\n"
+				 " -O --fmm-report     instead of simulating, print error and time of\n"
+				 "                     fast multipole method with each expansion order\n"
+				 " -q --quiet          print timing only, not the final state\n"
+				 "Final state is printed to standard output as lines of\n"
+				 "<name> <x> <y> <z> <vx> <vy> <vz>, timing to standard error.");
+			return 0;
+		default:
+			return 1;
+		}
+	}
+
+	/* Expansions of nodes closer then that would not converge. */
+	if ((mn::physics::Objects::solver == mn::physics::Objects::FMM ||
+	     mn::physics::fmmReport) && !(mn::physics::Objects::theta < 1)) {
+		fprintf(stderr, "%g: opening angle of fast multipole method must "
+		        "be less then one\n", (double)mn::physics::Objects::theta);
+		return 1;
+	}
+
+	/* Block time steps calculate jerks along with forces by direct
+	 * summation of their own. */
+	if ((mn::physics::Objects::integrator == mn::physics::Objects::BLOCK ||
+	     mn::physics::Objects::integrator == mn::physics::Objects::HERMITE) &&
+	    (mn::physics::Objects::solver != mn::physics::Objects::DIRECT ||
+	     mn::physics::Objects::useKernel || mn::physics::Objects::fieldCells)) {
+		fprintf(stderr, "%s integrator calculates forces by direct sum; "
+		        "-b, -p, -f, -s, -M and -F cannot be used with it\n",
+		        mn::physics::integratorNames[mn::physics::Objects::integrator]);
+		return 1;
+	}
+
+	if (argc - optind != 3) {
+		fprintf(stderr, "usage: %s [ <options> ] <data-file> <ticks> <dt>\n",
+		        argv[0]);
+		return 1;
+	}
+
+	const unsigned long ticks = strtoul(argv[optind + 1], 0, 0);
+	const double dt = atof(argv[optind + 2]);
+	if (!ticks) {
+		fprintf(stderr, "%s: invalid number of ticks\n", argv[optind + 1]);
+		return 1;
+	}
+	if (!(dt > 0)) {
+		fprintf(stderr, "%s: invalid time step\n", argv[optind + 2]);
+		return 1;
+	}
+
+	int ret;
+	if (mn::physics::energyDrift || mn::physics::benchmarkError > 0 ||
+	    mn::physics::precisionReport || mn::physics::fmmReport) {
+		if (ticks > std::numeric_limits<unsigned>::max()) {
+			fprintf(stderr, "%s: too many ticks for a report\n",
+			        argv[optind + 1]);
+			return 1;
+		}
+		switch (precision) {
+		case 'f':
+			ret = mn::physics::report<float>(argv[optind], ticks, dt);
+			break;
+		case 'l':
+			ret = mn::physics::report<long double>(argv[optind], ticks, dt);
+			break;
+		default:
+			ret = mn::physics::report<double>(argv[optind], ticks, dt);
+		}
+	} else {
+		switch (precision) {
+		case 'f':
+			ret = mn::physics::simulate<float>(argv[optind], ticks, dt, quiet,
+			                                   checkThreads);
+			break;
+		case 'l':
+			ret = mn::physics::simulate<long double>(argv[optind], ticks, dt,
+			                                         quiet, checkThreads);
+			break;
+		default:
+			ret = mn::physics::simulate<double>(argv[optind], ticks, dt,
+			                                    quiet, checkThreads);
+		}
+	}
+
+	mn::physics::ThreadPool::destroy();
+	return ret;
+}
@@ -0,0 +1,359 @@
+/*
+ * src/physics/bench.cpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/resource.h>
+
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <random>
+#include <string>
+#include <type_traits>
+
+#include "object.hpp"
+#include "report.hpp"
+#include "thread-pool.hpp"
+
+
+/** \file
+ *
+ * Measures simulation throughput.  For each solver simulates
+ * synthetic scenes of 10, 100, ... bodies and prints a CSV line with
+ * number of interactions actually calculated per second (see
+ * BasicObjects::getInteractions()), time per body per tick and memory
+ * use.  Given results of a previous run, fails if any case got
+ * slower by more than a given ratio.
+ */
+
+
+namespace mn {
+
+namespace physics {
+
+
+namespace {
+
+/** A solver configuration being benchmarked. */
+struct Solver {
+	const char *name;
+	ObjectsBase::Solver solver;
+	bool useKernel, mixed;
+	/** Whether cost of a tick grows like N^2 (or else like N log N). */
+	bool quadratic;
+	/**
+	 * Whether bodies are sorted by Morton code (see
+	 * BasicObjects::sortAll()); synthetic bodies are in random order
+	 * otherwise so comparing the two shows the effect of locality.
+	 */
+	bool morton;
+};
+
+const Solver solvers[] = {
+	{ "direct",      ObjectsBase::DIRECT,     false, false, true,  false },
+	{ "simd",        ObjectsBase::DIRECT,     true,  false, true,  false },
+	{ "simd-mixed",  ObjectsBase::DIRECT,     true,  true,  true,  false },
+	{ "symmetric",   ObjectsBase::SYMMETRIC,  false, false, true,  false },
+	{ "barnes-hut",  ObjectsBase::BARNES_HUT, false, false, false, false },
+	{ "barnes-hut-z",ObjectsBase::BARNES_HUT, false, false, false, true  },
+	{ "fmm",         ObjectsBase::FMM,        false, false, false, false },
+	{ "fmm-z",       ObjectsBase::FMM,        false, false, false, true  },
+};
+
+const unsigned solversCount = sizeof solvers / sizeof *solvers;
+
+}
+
+
+/**
+ * Creates n bodies with random masses placed uniformly in a cube
+ * whose size grows with n so that density stays the same.
+ */
+template<class T>
+static void synthesize(BasicObjects<T> &objects, unsigned n) {
+	typedef typename BasicObjects<T>::Vector Vector;
+
+	std::mt19937 gen(n);
+	const double side = 2 * std::cbrt((double)n);
+	std::uniform_real_distribution<double> position(-side / 2, side / 2);
+	std::uniform_real_distribution<double> velocity(-0.1, 0.1);
+	std::uniform_real_distribution<double> mass(0.5, 1.5);
+
+	char name[16];
+	for (unsigned i = 0; i < n; ++i) {
+		sprintf(name, "b%u", i);
+		const unsigned k = objects.add(name);
+		objects.setPosition(k, Vector(position(gen), position(gen),
+		                              position(gen)));
+		objects.setVelocity(k, Vector(velocity(gen), velocity(gen),
+		                              velocity(gen)));
+		objects.setMass(k, mass(gen));
+	}
+}
+
+
+static double cost(const Solver &solver, double n) {
+	return solver.quadratic ? n * n : n * std::log(n);
+}
+
+
+static unsigned long long peakMemory() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return (unsigned long long)usage.ru_maxrss * 1024;
+}
+
+
+static std::string key(const char *solver, const char *precision,
+                       unsigned bodies) {
+	return std::string(solver) + '/' + precision + '/' +
+		std::to_string(bodies);
+}
+
+
+/**
+ * Reads results of a previous run.  Lines which do not parse (such
+ * as the header) are ignored.
+ */
+static bool readBaseline(const char *file,
+                         std::map<std::string, double> &baseline) {
+	FILE *const fp = fopen(file, "r");
+	if (!fp) {
+		perror(file);
+		return false;
+	}
+
+	char line[256], solver[32], precision[32];
+	unsigned bodies;
+	double ns;
+	while (fgets(line, sizeof line, fp)) {
+		if (sscanf(line, "%31[^,],%31[^,],%u,%*u,%lg",
+		           solver, precision, &bodies, &ns) == 4) {
+			baseline[key(solver, precision, bodies)] = ns;
+		}
+	}
+
+	fclose(fp);
+	return true;
+}
+
+
+/**
+ * Runs all cases with given scalar type and prints results.
+ * \return whether any case is slower than in the baseline by more
+ *         than the threshold.
+ */
+template<class T>
+static bool benchmark(const char *precision, unsigned maxBodies,
+                      double minTime, double maxTime, double threshold,
+                      const std::map<std::string, double> &baseline) {
+	typedef std::chrono::steady_clock clock;
+
+	/* Time of a tick measured for the previous scene; zero if solver
+	 * is no longer run. */
+	double lastTick[solversCount];
+	unsigned lastBodies = 0;
+	for (unsigned s = 0; s < solversCount; ++s) {
+		lastTick[s] = -1;
+	}
+
+	bool regression = false;
+	for (unsigned n = 10; n <= maxBodies; n *= 10) {
+		for (unsigned s = 0; s < solversCount; ++s) {
+			const Solver &solver = solvers[s];
+			/* Mixed precision kernel is used only with double. */
+			if (!lastTick[s] ||
+			    (solver.mixed && !std::is_same<T, double>::value)) {
+				continue;
+			}
+			if (lastTick[s] > 0 &&
+			    lastTick[s] * cost(solver, n) / cost(solver, lastBodies) >
+			    maxTime) {
+				fprintf(stderr, "%s/%s: skipping %u and more bodies\n",
+				        solver.name, precision, n);
+				lastTick[s] = 0;
+				continue;
+			}
+
+			ObjectsBase::solver = solver.solver;
+			ObjectsBase::useKernel = solver.useKernel;
+			ObjectsBase::mixed = solver.mixed;
+			if (solver.useKernel) {
+				kernel::parse("auto", ObjectsBase::isa);
+			}
+
+			ObjectsBase::sortInterval = solver.morton ? 100 : 0;
+
+			BasicObjects<T> objects;
+			synthesize(objects, n);
+			if (solver.morton) {
+				objects.sortAll();
+			}
+
+			unsigned long ticks = 0;
+			double seconds;
+			const clock::time_point start = clock::now();
+			do {
+				objects.tickAll(1 / 250.0);
+				objects.updatePointAll();
+				++ticks;
+				seconds = std::chrono::duration<double>(clock::now() -
+				                                        start).count();
+			} while (seconds < minTime);
+
+			lastTick[s] = seconds / ticks;
+			const double ns = seconds * 1e9 / ((double)ticks * n);
+			printf("%s,%s,%u,%lu,%.6g,%.6g,%.6g,%llu,%llu\n",
+			       solver.name, precision, n, ticks, ns, seconds,
+			       (double)objects.getInteractions() / seconds,
+			       objects.memoryUsage(), peakMemory());
+			fflush(stdout);
+
+			const std::map<std::string, double>::const_iterator it =
+				baseline.find(key(solver.name, precision, n));
+			if (it != baseline.end() && ns > it->second * (1 + threshold)) {
+				fprintf(stderr, "%s/%s with %u bodies: %g ns per body per "
+				        "tick, %g in baseline (%+.1f%%)\n", solver.name,
+				        precision, n, ns, it->second,
+				        (ns / it->second - 1) * 100);
+				regression = true;
+			}
+		}
+
+		lastBodies = n;
+		if (n > maxBodies / 10) {
+			break;
+		}
+	}
+
+	return regression;
+}
+
+}
+
+}
+
+
+int main(int argc, char** argv) {
+	static const struct option longopts[] = {
+		{ "max-bodies",  1, 0, 'n' },
+		{ "min-time",    1, 0, 'm' },
+		{ "max-time",    1, 0, 'T' },
+		{ "threads",     1, 0, 't' },
+		{ "integrator",  1, 0, 'i' },
+		{ "baseline",    1, 0, 'B' },
+		{ "threshold",   1, 0, 'r' },
+		{ "precision",   1, 0, 'P' },
+		{ "help",        0, 0, '?' },
+		{ 0, 0, 0, 0 }
+	};
+	int opt;
+	unsigned maxBodies = 1000000;
+	double minTime = 0.5, maxTime = 10, threshold = 0.1;
+	const char *baselineFile = 0, *precision = 0;
+	while ((opt = getopt_long(argc, argv, "?n:m:T:t:i:B:r:P:", longopts, 0))!=-1){
+		switch (opt) {
+		case 'n': maxBodies = strtoul(optarg, 0, 0); break;
+		case 'm': minTime = atof(optarg); break;
+		case 'T': maxTime = atof(optarg); break;
+		case 't':
+			if (!mn::physics::ThreadPool::parseThreads(optarg,
+			                       mn::physics::ThreadPool::threads)) {
+				fprintf(stderr, "%s: invalid number of threads\n", optarg);
+				return 1;
+			}
+			break;
+		case 'i':
+			if (!mn::physics::parseIntegrator(optarg,
+			                                  mn::physics::Objects::integrator)) {
+				fprintf(stderr, "%s: unknown integrator\n", optarg);
+				return 1;
+			}
+			/* They would run every solver as a direct sum. */
+			if (mn::physics::Objects::integrator ==
+			    mn::physics::Objects::BLOCK ||
+			    mn::physics::Objects::integrator ==
+			    mn::physics::Objects::HERMITE) {
+				fprintf(stderr, "%s: integrator does not use benchmarked "
+				        "solvers\n", optarg);
+				return 1;
+			}
+			break;
+		case 'B': baselineFile = optarg; break;
+		case 'r': threshold = atof(optarg); break;
+		case 'P':
+			if (strcmp(optarg, "float") && strcmp(optarg, "double") &&
+			    strcmp(optarg, "long-double")) {
+				fprintf(stderr, "%s: unknown precision\n", optarg);
+				return 1;
+			}
+			precision = optarg;
+			break;
+		case '?':
+			puts("usage: ./physics-bench [ <options> ]\n"
+				 "<options>:\n"
+				 " -n --max-bodies=<n> largest scene (1000000 by default)\n"
+				 " -m --min-time=<s>   minimal time each case runs (0.5 s by default)\n"
+				 " -T --max-time=<s>   skip cases whose single tick is expected to\n"
+				 "                     take longer (10 s by default)\n"
+				 " -t --threads=<n>    number of threads calculating forces\n"
+				 "                     (number of CPUs by default)\n"
+				 " -i --integrator=<name>\n"
+				 "                     euler (default) or verlet\n"
+				 " -B --baseline=<file>\n"
+				 "                     output of a previous run to compare with\n"
+				 " -r --threshold=<ratio>\n"
+				 "                     fail if time per body per tick grew by more\n"
+				 "                     than given ratio (0.1 by default)\n"
+				 " -P --precision=<type>\n"
+				 "                     run only with float, double or long-double\n"
+				 "                     (all three by default)\n"
+				 "Results are printed to standard output in CSV format.");
+			return 0;
+		default:
+			return 1;
+		}
+	}
+
+	std::map<std::string, double> baseline;
+	if (baselineFile && !mn::physics::readBaseline(baselineFile, baseline)) {
+		return 1;
+	}
+
+	puts("solver,precision,bodies,ticks,ns_per_body_tick,seconds,"
+	     "interactions_per_second,objects_bytes,peak_rss_bytes");
+
+	bool regression = false;
+	if (!precision || !strcmp(precision, "float")) {
+		regression |= mn::physics::benchmark<float>(
+			"float", maxBodies, minTime, maxTime, threshold, baseline);
+	}
+	if (!precision || !strcmp(precision, "double")) {
+		regression |= mn::physics::benchmark<double>(
+			"double", maxBodies, minTime, maxTime, threshold, baseline);
+	}
+	if (!precision || !strcmp(precision, "long-double")) {
+		regression |= mn::physics::benchmark<long double>(
+			"long-double", maxBodies, minTime, maxTime, threshold, baseline);
+	}
+
+	mn::physics::ThreadPool::destroy();
+	return regression ? 1 : 0;
+}
@@ -0,0 +1,257 @@
+/*
+ * src/physics/block-steps.cpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "object.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "thread-pool.hpp"
+
+
+namespace mn {
+
+namespace physics {
+
+
+template<class T>
+void BasicObjects<T>::derivatives(const std::vector<unsigned> &targets) {
+	evaluations += targets.size();
+	interactions += (unsigned long long)targets.size() * (size() - 1);
+
+	ThreadPool::pool()->run(targets.size(),
+	                        [this, &targets](unsigned begin, unsigned end) {
+		force::dispatch<T>(forceLaw, softening, [&](const auto &gravity) {
+			derivatives(gravity, targets, begin, end);
+		});
+	});
+}
+
+template<class T>
+template<class Force>
+void BasicObjects<T>::derivatives(const Force &gravity,
+                                  const std::vector<unsigned> &targets,
+                                  unsigned begin, unsigned end) {
+	for (unsigned k = begin; k < end; ++k) {
+		const unsigned i = targets[k];
+		const value_type px = predX[i], py = predY[i], pz = predZ[i];
+		const value_type pvx = predVX[i], pvy = predVY[i];
+		const value_type pvz = predVZ[i];
+		value_type sax = 0, say = 0, saz = 0, sjx = 0, sjy = 0, sjz = 0;
+
+		for (unsigned j = 0, n = size(); j < n; ++j) {
+			if (j == i || mass[j] < force::minMass) continue;
+			const value_type rx = predX[j] - px, ry = predY[j] - py;
+			const value_type rz = predZ[j] - pz;
+			const value_type l2 = rx * rx + ry * ry + rz * rz;
+			if (gravity.skip(l2)) continue;
+
+			const value_type wx = predVX[j] - pvx, wy = predVY[j] - pvy;
+			const value_type wz = predVZ[j] - pvz;
+			const value_type f = mass[j] * gravity.factor(l2);
+			const value_type rw =
+				(rx * wx + ry * wy + rz * wz) * gravity.jerk(l2);
+
+			sax += f * rx;
+			say += f * ry;
+			saz += f * rz;
+			sjx += f * (wx - rw * rx);
+			sjy += f * (wy - rw * ry);
+			sjz += f * (wz - rw * rz);
+		}
+
+		ax[i] = G * sax;
+		ay[i] = G * say;
+		az[i] = G * saz;
+		jx[i] = G * sjx;
+		jy[i] = G * sjy;
+		jz[i] = G * sjz;
+	}
+}
+
+
+template<class T>
+unsigned BasicObjects<T>::blockLevel(unsigned i, value_type dt) const {
+	const value_type a2 = ax[i] * ax[i] + ay[i] * ay[i] + az[i] * az[i];
+	const value_type j2 = jx[i] * jx[i] + jy[i] * jy[i] + jz[i] * jz[i];
+	if (!(j2 > 0)) {
+		return 0;
+	}
+
+	const value_type ideal = eta * std::sqrt(a2 / j2);
+	unsigned k = 0;
+	for (value_type step = dt; step > ideal && k < maxLevel; step /= 2) {
+		++k;
+	}
+	return k;
+}
+
+
+template<class T>
+void BasicObjects<T>::blockTick(value_type dt, bool shared) {
+	const unsigned n = size();
+	ax.resize(n); ay.resize(n); az.resize(n);
+	jx.resize(n); jy.resize(n); jz.resize(n);
+	predX.resize(n); predY.resize(n); predZ.resize(n);
+	predVX.resize(n); predVY.resize(n); predVZ.resize(n);
+	level.resize(n);
+	since.resize(n);
+
+	/* Time inside of a tick is measured in units of the shortest
+	 * possible step so that block boundaries are exact. */
+	const unsigned long end = 1ul << maxLevel;
+	const value_type quantum = dt / end;
+
+	std::vector<unsigned> active;
+	for (unsigned i = 0; i < n; ++i) {
+		if (!frozen[i]) {
+			active.push_back(i);
+		}
+	}
+
+	if (!jerksValid) {
+		for (unsigned i = 0; i < n; ++i) {
+			predX[i] = x[i];
+			predY[i] = y[i];
+			predZ[i] = z[i];
+			predVX[i] = frozen[i] ? 0 : vx[i];
+			predVY[i] = frozen[i] ? 0 : vy[i];
+			predVZ[i] = frozen[i] ? 0 : vz[i];
+		}
+		derivatives(active);
+	}
+
+	for (unsigned k = 0; k < active.size(); ++k) {
+		const unsigned i = active[k];
+		level[i] = shared ? 0 : blockLevel(i, dt);
+		since[i] = 0;
+	}
+
+	const std::vector<unsigned> moving(active);
+	std::vector<value_type> old;
+
+	while (!moving.empty()) {
+		unsigned long now = end;
+		for (unsigned k = 0; k < moving.size(); ++k) {
+			const unsigned i = moving[k];
+			now = std::min(now, since[i] + (end >> level[i]));
+		}
+
+		active.clear();
+		for (unsigned k = 0; k < moving.size(); ++k) {
+			const unsigned i = moving[k];
+			if (since[i] + (end >> level[i]) == now) {
+				active.push_back(i);
+			}
+		}
+
+		/* Extrapolate all objects to current time. */
+		ThreadPool::pool()->run(n, [this, now, quantum](unsigned first,
+		                                                unsigned last) {
+			for (unsigned i = first; i < last; ++i) {
+				if (frozen[i]) {
+					predX[i] = x[i];
+					predY[i] = y[i];
+					predZ[i] = z[i];
+					predVX[i] = predVY[i] = predVZ[i] = 0;
+					continue;
+				}
+
+				const value_type t = (now - since[i]) * quantum;
+				predX[i] = x[i] + t * (vx[i] + t * (ax[i] / 2 + t * jx[i] / 6));
+				predY[i] = y[i] + t * (vy[i] + t * (ay[i] / 2 + t * jy[i] / 6));
+				predZ[i] = z[i] + t * (vz[i] + t * (az[i] / 2 + t * jz[i] / 6));
+				predVX[i] = vx[i] + t * (ax[i] + t * jx[i] / 2);
+				predVY[i] = vy[i] + t * (ay[i] + t * jy[i] / 2);
+				predVZ[i] = vz[i] + t * (az[i] + t * jz[i] / 2);
+			}
+		});
+
+		/* Keep accelerations and jerks from the beginning of the step,
+		 * x, y, z, vx, vy and vz still hold values from that time. */
+		old.resize(6 * active.size());
+		for (unsigned k = 0; k < active.size(); ++k) {
+			const unsigned i = active[k];
+			value_type *const o = &old[6 * k];
+			o[0] = ax[i]; o[1] = ay[i]; o[2] = az[i];
+			o[3] = jx[i]; o[4] = jy[i]; o[5] = jz[i];
+		}
+
+		derivatives(active);
+
+		/* Fourth order Hermite corrector. */
+		for (unsigned k = 0; k < active.size(); ++k) {
+			const unsigned i = active[k];
+			const value_type *const o = &old[6 * k];
+			const value_type h = (now - since[i]) * quantum;
+			const value_type h2 = h * h / 12;
+
+			const value_type nvx = vx[i] + (o[0] + ax[i]) * (h / 2) + (o[3] - jx[i]) * h2;
+			const value_type nvy = vy[i] + (o[1] + ay[i]) * (h / 2) + (o[4] - jy[i]) * h2;
+			const value_type nvz = vz[i] + (o[2] + az[i]) * (h / 2) + (o[5] - jz[i]) * h2;
+			x[i] += (vx[i] + nvx) * (h / 2) + (o[0] - ax[i]) * h2;
+			y[i] += (vy[i] + nvy) * (h / 2) + (o[1] - ay[i]) * h2;
+			z[i] += (vz[i] + nvz) * (h / 2) + (o[2] - az[i]) * h2;
+			vx[i] = nvx;
+			vy[i] = nvy;
+			vz[i] = nvz;
+			since[i] = now;
+
+			if (shared) {
+				continue;
+			}
+
+			/* Step may always be shortened but can be made longer only
+			 * if current time is its multiple. */
+			const unsigned desired = blockLevel(i, dt);
+			if (desired >= level[i]) {
+				level[i] = desired;
+			} else if (!(now % (end >> (level[i] - 1)))) {
+				--level[i];
+			}
+		}
+
+		if (now == end) {
+			break;
+		}
+	}
+
+	nextX = x;
+	nextY = y;
+	nextZ = z;
+	accelerationsValid = jerksValid = true;
+}
+
+
+/* Rest of BasicObjects is instantiated in object.cpp. */
+#define INSTANTIATE(T) \
+	template void BasicObjects<T>::derivatives( \
+		const std::vector<unsigned> &targets); \
+	template unsigned BasicObjects<T>::blockLevel(unsigned i, T dt) const; \
+	template void BasicObjects<T>::blockTick(T dt, bool shared)
+
+INSTANTIATE(float);
+INSTANTIATE(double);
+INSTANTIATE(long double);
+
+#undef INSTANTIATE
+
+
+}
+
+}
@@ -0,0 +1,233 @@
+/*
+ * src/physics/collisions.cpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "object.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "thread-pool.hpp"
+
+
+namespace mn {
+
+namespace physics {
+
+
+/** Returns root of i-th object's group updating links on the way. */
+static unsigned findRoot(std::vector<unsigned> &parent, unsigned i) {
+	while (parent[i] != i) {
+		i = parent[i] = parent[parent[i]];
+	}
+	return i;
+}
+
+
+/** Hashes coordinates of a grid cell. */
+static unsigned long long cellHash(long long x, long long y, long long z) {
+	return (unsigned long long)x * 73856093ull ^
+		(unsigned long long)y * 19349663ull ^
+		(unsigned long long)z * 83492791ull;
+}
+
+
+/** Removes elements whose indexes are not listed in \a keep. */
+template<class V>
+static void compact(std::vector<V> &v, const std::vector<unsigned> &keep) {
+	for (unsigned k = 0; k < keep.size(); ++k) {
+		if (keep[k] != k) {
+			v[k] = v[keep[k]];
+		}
+	}
+	v.erase(v.begin() + keep.size(), v.end());
+}
+
+
+template<class T>
+unsigned BasicObjects<T>::collideAll() {
+	const unsigned n = size();
+
+	value_type biggest = 0;
+	for (unsigned i = 0; i < n; ++i) {
+		biggest = std::max(biggest, sizes[i]);
+	}
+	if (n < 2 || !(biggest > 0)) {
+		return 0;
+	}
+
+	/* Cells are at least twice as wide as the distance at which
+	 * objects may touch so only the object's cell and its seven
+	 * neighbours towards the nearest faces, edges and corner need to
+	 * be checked.  Cells are hashed into a table with at least twice
+	 * as many buckets as there are objects and each bucket holds
+	 * a list of objects linked through next. */
+	const value_type width = 4 * biggest;
+	unsigned buckets = 1;
+	while (buckets < 2 * n) {
+		buckets <<= 1;
+	}
+
+	const unsigned mask = buckets - 1;
+	std::vector<unsigned> heads(buckets, (unsigned)none), next(n), parent(n);
+	for (unsigned i = 0; i < n; ++i) {
+		const unsigned long long hash =
+			cellHash((long long)std::floor(x[i] / width),
+			         (long long)std::floor(y[i] / width),
+			         (long long)std::floor(z[i] / width));
+		next[i] = heads[hash & mask];
+		heads[hash & mask] = i;
+		parent[i] = i;
+	}
+
+	/* Calls f with each object of lower index which touches i-th one
+	 * (so each pair is seen once; a pair may still be seen twice if
+	 * two cells share a bucket which is harmless) until it returns
+	 * true. */
+	const auto touching = [&](unsigned i, const auto &f) {
+		const value_type fx = std::floor(x[i] / width);
+		const value_type fy = std::floor(y[i] / width);
+		const value_type fz = std::floor(z[i] / width);
+		const long long cx = fx, cy = fy, cz = fz;
+		/* Neighbouring cell on the side of the nearer face. */
+		const int sx = x[i] / width - fx < 0.5 ? -1 : 1;
+		const int sy = y[i] / width - fy < 0.5 ? -1 : 1;
+		const int sz = z[i] / width - fz < 0.5 ? -1 : 1;
+
+		for (int d = 0; d < 8; ++d) {
+			const unsigned long long hash =
+				cellHash(cx + (d & 1 ? sx : 0), cy + (d & 2 ? sy : 0),
+				         cz + (d & 4 ? sz : 0));
+			for (unsigned j = heads[hash & mask]; j != none; j = next[j]) {
+				if (j >= i || (frozen[i] && frozen[j])) continue;
+
+				const value_type rx = x[j] - x[i], ry = y[j] - y[i];
+				const value_type rz = z[j] - z[i];
+				const value_type r = sizes[i] + sizes[j];
+				if (rx * rx + ry * ry + rz * rz < r * r && f(j)) {
+					return;
+				}
+			}
+		}
+	};
+
+	/* Looking for touching objects is what takes time and is done in
+	 * parallel; merging of the (few) objects found is done serially
+	 * in order of indexes so result does not depend on threads. */
+	std::vector<unsigned char> touches(n, 0);
+	ThreadPool::pool()->run(n, [&](unsigned begin, unsigned end) {
+		for (unsigned i = begin; i < end; ++i) {
+			touching(i, [&](unsigned) {
+				touches[i] = 1;
+				return true;
+			});
+		}
+	});
+
+	unsigned merged = 0;
+	for (unsigned i = 0; i < n; ++i) {
+		if (!touches[i]) continue;
+		touching(i, [&](unsigned j) {
+			/* Frozen object absorbs the other one, otherwise the
+			 * heavier one does. */
+			unsigned a = findRoot(parent, i), b = findRoot(parent, j);
+			if (a == b) return false;
+			if (frozen[b] > frozen[a] ||
+			    (frozen[b] == frozen[a] && mass[b] > mass[a])) {
+				std::swap(a, b);
+			}
+			parent[b] = a;
+			++merged;
+			return false;
+		});
+	}
+
+	if (!merged) {
+		return 0;
+	}
+
+	/* Sum masses, momenta, moments and volumes of each group in its
+	 * root.  Objects which absorbed nothing are left intact. */
+	std::vector<value_type> sums(8 * n, 0);
+	std::vector<unsigned char> absorbs(n, 0);
+	for (unsigned i = 0; i < n; ++i) {
+		const unsigned root = findRoot(parent, i);
+		value_type *const sum = &sums[8 * root];
+		sum[0] += mass[i];
+		sum[1] += mass[i] * vx[i];
+		sum[2] += mass[i] * vy[i];
+		sum[3] += mass[i] * vz[i];
+		sum[4] += mass[i] * x[i];
+		sum[5] += mass[i] * y[i];
+		sum[6] += mass[i] * z[i];
+		sum[7] += sizes[i] * sizes[i] * sizes[i];
+		absorbs[root] |= root != i;
+	}
+
+	std::vector<unsigned> keep;
+	keep.reserve(n - merged);
+	for (unsigned i = 0; i < n; ++i) {
+		if (parent[i] != i) {
+			continue;
+		}
+		keep.push_back(i);
+		if (!absorbs[i]) {
+			continue;
+		}
+
+		/* Frozen object stays where it is but its field changes. */
+		const value_type *const sum = &sums[8 * i];
+		if (frozen[i]) {
+			fieldValid = false;
+		}
+		if (sum[0] > 0 && !frozen[i]) {
+			vx[i] = sum[1] / sum[0];
+			vy[i] = sum[2] / sum[0];
+			vz[i] = sum[3] / sum[0];
+			x[i] = nextX[i] = sum[4] / sum[0];
+			y[i] = nextY[i] = sum[5] / sum[0];
+			z[i] = nextZ[i] = sum[6] / sum[0];
+		}
+		mass[i] = sum[0];
+		sizes[i] = std::cbrt(sum[7]);
+	}
+
+	compact(x, keep); compact(y, keep); compact(z, keep);
+	compact(nextX, keep); compact(nextY, keep); compact(nextZ, keep);
+	compact(vx, keep); compact(vy, keep); compact(vz, keep);
+	compact(mass, keep);
+	compact(sizes, keep);
+	compact(frozen, keep);
+	compact(objects, keep);
+	compact(ids, keep);
+
+	merges += merged;
+	accelerationsValid = jerksValid = tracersValid = false;
+	rearranged();
+	return merged;
+}
+
+
+/* Rest of BasicObjects is instantiated in object.cpp. */
+template unsigned BasicObjects<float>::collideAll();
+template unsigned BasicObjects<double>::collideAll();
+template unsigned BasicObjects<long double>::collideAll();
+
+
+}
+
+}
@@ -21,10 +21,13 @@
 #include <stdio.h>
 #include <math.h>
 
+#include <cmath>
+#include <random>
 #include <stdexcept>
 #include <vector>
 #include <string>
 
+#include "../common/mconst.h"
 #include "object.hpp"
 #include "lexer.hpp"
 
@@ -35,26 +38,60 @@ namespace physics {
 
 
 
-static void autoVelocity(Object &object, const char *name) {
-	const Object *const o = object.find(name);
+template<class T>
+static void autoVelocity(BasicObjects<T> &objects, unsigned object,
+                         const char *name) {
+	const unsigned o = objects.find(name);
 	delete[] name;
-	if (!o) {
+	if (o == BasicObjects<T>::none) {
 		return;
 	}
 
-	const Object::Vector r = o->getPosition() - object.getPosition();
-	const float l2 = r.length2();
+	const typename BasicObjects<T>::Vector r =
+		objects.getPosition(o) - objects.getPosition(object);
+	const T l2 = r.length2();
 	if (l2 < 0.01) {
 		return;
 	}
 
-	const float V2 = Object::G * o->getMass() / sqrtf(l2);
-	object.getVelocity().normalize();
-	object.setVelocity(object.getVelocity() * sqrt(V2));
+	const T V2 = BasicObjects<T>::G * objects.getMass(o) / std::sqrt(l2);
+	typename BasicObjects<T>::Vector velocity = objects.getVelocity(object);
+	velocity.normalize();
+	objects.setVelocity(object, velocity * std::sqrt(V2));
 }
 
 
-Object *loadData(const char *filename) {
+/**
+ * Adds tracers orbiting given object in a flat ring lying in the x-z
+ * plane, spread evenly over the ring's area.  Random generator has
+ * a fixed seed so that each run gets the same cloud.
+ */
+template<class T>
+static void addCloud(BasicObjects<T> &objects, unsigned count,
+                     unsigned center, T inner, T outer) {
+	typedef typename BasicObjects<T>::Vector Vector;
+	const Vector position = objects.getPosition(center);
+	const Vector velocity = objects.getVelocity(center);
+	const T GM = BasicObjects<T>::G * objects.getMass(center);
+
+	std::mt19937 random;
+	std::uniform_real_distribution<double> unit(0, 1);
+	for (unsigned k = 0; k < count; ++k) {
+		const T r = std::sqrt(inner * inner +
+		                      unit(random) * (outer * outer - inner * inner));
+		const T phi = MN_2PI * unit(random);
+		const T sin = std::sin(phi), cos = std::cos(phi);
+		const T V = std::sqrt(GM / r);
+		objects.addTracer(position + Vector(r * sin, 0, r * cos),
+		                  velocity + Vector(V * cos, 0, -V * sin));
+	}
+}
+
+
+template<class T>
+BasicObjects<T> *loadData(const char *filename) {
+	typedef BasicObjects<T> Objects;
+
 	Lexer lexer(filename);
 	if (!lexer) {
 		fprintf(stderr, "%s: could not open\n", filename);
@@ -74,24 +111,42 @@ Object *loadData(const char *filename) {
 		S_COLOR,            /* takes 3 floats */
 		S_COLOR_READ_1,
 		S_COLOR_READ_2,
-		S_FACTOR
+		S_FACTOR,
+		S_FORCE,            /* takes law and optional float */
+		S_FORCE_DONE
 	};
 	unsigned state = S_START;
-	Object *object = 0;
+	Objects *objects = new Objects();
+	unsigned object = 0;
+	typename Objects::Vector position;
 
 	Lexer::Value value;
 	Lexer::Location location;
 	int token, lights = 0;
-	float x, y;
+	T x, y;
 
-	float massFactor = 1, sizeFactor = 1, distFactor = 1, velFactor = 1;
+	T massFactor = 1, sizeFactor = 1, distFactor = 1, velFactor = 1;
 
 	for(;;) {
 		token = lexer.nextToken(value, location);
 
 		switch ((enum State)state) {
+		case S_FORCE_DONE:
+			if (token == Lexer::T_REAL) {
+				if (!(value.real > 0)) goto error;
+				ObjectsBase::softening = value.real * distFactor;
+				state = objects->empty() ? S_START : S_CONT;
+				break;
+			}
+			if (!objects->empty()) {
+				state = S_CONT;
+				goto s_cont;
+			}
+			/* FALL THROUGH */
+
 		case S_START:
 			if (token == '*') { state = S_FACTOR; break; }
+			if (token == Lexer::T_FORCE) { state = S_FORCE; break; }
 			if (token != Lexer::T_STRING) goto error;
 			goto s_cont_string;
 
@@ -100,23 +155,25 @@ Object *loadData(const char *filename) {
 			if (token == Lexer::T_AUTO) {
 				token = lexer.nextToken(value, location);
 				if (token != Lexer::T_STRING) goto error;
-				autoVelocity(*object, value.string);
+				autoVelocity(*objects, object, value.string);
 				break;
 			}
 			/* FALL THROUGH */
 
 		case S_CONT:
+		s_cont:
 			switch (token) {
 
 			s_cont_string:
 				state = S_CONT;
 				/* FALL THROUGH */
 			case Lexer::T_STRING:
-				object = new Object(value.string, object);
+				object = objects->add(value.string);
 				delete[] value.string;
 				break;
 
 			case '*'              : state = S_FACTOR  ; break;
+			case Lexer::T_FORCE   : state = S_FORCE   ; break;
 			case '@'              : state = S_POSITION; break;
 			case Lexer::T_VELOCITY: state = S_VELOCITY; break;
 			case Lexer::T_COLOR   : state = S_COLOR   ; break;
@@ -124,54 +181,86 @@ Object *loadData(const char *filename) {
 			case 'x':
 				token = lexer.nextToken(value, location);
 				if (token != Lexer::T_REAL) goto error;
-				object->getPosition().x =value.real * distFactor;
+				position = objects->getPosition(object);
+				position.x = value.real * distFactor;
+				objects->setPosition(object, position);
 				break;
 
 			case 'y':
 				token = lexer.nextToken(value, location);
 				if (token != Lexer::T_REAL) goto error;
-				object->getPosition().y =value.real * distFactor;
+				position = objects->getPosition(object);
+				position.y = value.real * distFactor;
+				objects->setPosition(object, position);
 				break;
 
 			case 'z':
 				token = lexer.nextToken(value, location);
 				if (token != Lexer::T_REAL) goto error;
-				object->getPosition().z =value.real * distFactor;
+				position = objects->getPosition(object);
+				position.z = value.real * distFactor;
+				objects->setPosition(object, position);
 				break;
 
 			case Lexer::T_FROZEN:
-				if (object->isFrozen()) goto error;
-				object->setFrozen(true);
+				if (objects->isFrozen(object)) goto error;
+				objects->setFrozen(object, true);
 				break;
 
 			case Lexer::T_LIGHT:
-				if (object->getLight() >= 0) goto error;
-				object->setLight(++lights);
+				if ((*objects)[object].light >= 0) goto error;
+				(*objects)[object].light = ++lights;
 				break;
 
 			case Lexer::T_SIZE:
 				token = lexer.nextToken(value, location);
 				if (token != Lexer::T_REAL) goto error;
-				object->setSize(value.real * sizeFactor);
+				objects->setSize(object, value.real * sizeFactor);
 				break;
 
 			case Lexer::T_MASS:
 				token = lexer.nextToken(value, location);
 				if (token != Lexer::T_REAL) goto error;
-				object->setMass(value.real * massFactor);
+				objects->setMass(object, value.real * massFactor);
 				break;
 
 			case Lexer::T_TEXTURE:
-				if (object->texture) goto error;
+				if (!(*objects)[object].texture.empty()) goto error;
 				token = lexer.nextToken(value, location);
 				if (token != Lexer::T_STRING) goto error;
-				object->texture.load(value.string);
-				object->colorFromTexture();
+				(*objects)[object].texture = value.string;
 				delete[] value.string;
 				break;
 
+			case Lexer::T_CLOUD: {
+				token = lexer.nextToken(value, location);
+				if (token != Lexer::T_REAL || !(value.real >= 1)) goto error;
+				const unsigned count = value.real;
+
+				token = lexer.nextToken(value, location);
+				if (token != Lexer::T_STRING) goto error;
+				const unsigned center = objects->find(value.string);
+				if (center == Objects::none) goto error;
+				delete[] value.string;
+
+				token = lexer.nextToken(value, location);
+				if (token != Lexer::T_REAL || !(value.real > 0)) goto error;
+				x = value.real * distFactor;
+				token = lexer.nextToken(value, location);
+				if (token != Lexer::T_REAL || !(value.real * distFactor >= x)) {
+					goto error;
+				}
+				addCloud(*objects, count, center, x,
+				         (T)(value.real * distFactor));
+				break;
+			}
+
 			case Lexer::T_EOF:
-				return object;
+				if (objects->empty()) {
+					delete objects;
+					return 0;
+				}
+				return objects;
 
 			default:
 				goto error;
@@ -196,26 +285,41 @@ Object *loadData(const char *filename) {
 
 		case S_POSITION_READ_2:
 			if (token != Lexer::T_REAL) goto error;
-			object->setPosition(x * distFactor, y * distFactor, value.real * distFactor);
+			objects->setPosition(object, typename Objects::Vector(
+				x * distFactor, y * distFactor, value.real * distFactor));
 			state = S_CONT;
 			break;
 
 		case S_VELOCITY_READ_2:
 			if (token != Lexer::T_REAL) goto error;
-			object->setVelocity(x * velFactor, y * velFactor, value.real * velFactor);
+			objects->setVelocity(object, typename Objects::Vector(
+				x * velFactor, y * velFactor, value.real * velFactor));
 			state = S_VELOCITY_DONE;
 			break;
 
 		case S_COLOR_READ_2:
 			if (token != Lexer::T_REAL) goto error;
-			object->setColor(x, y, value.real);
+			(*objects)[object].color = gl::color(x, y, value.real);
 			state = S_CONT;
 			break;
 
 
+		case S_FORCE:
+			switch (token) {
+			case Lexer::T_NEWTON : ObjectsBase::forceLaw = force::NEWTON ; break;
+			case Lexer::T_PLUMMER: ObjectsBase::forceLaw = force::PLUMMER; break;
+			case Lexer::T_CUTOFF : ObjectsBase::forceLaw = force::CUTOFF ; break;
+			default: goto error;
+			}
+			state = S_FORCE_DONE;
+			break;
+
+
 		case S_FACTOR: {
 			switch (token) {
 			case Lexer::T_STRING  : goto s_cont_string;
+			case Lexer::T_FORCE   : state = S_FORCE; continue;
+			case Lexer::T_CLOUD   : state = S_CONT; goto s_cont;
 			case '@'              :
 			case Lexer::T_MASS    :
 			case Lexer::T_SIZE    :
@@ -253,10 +357,17 @@ error:
 	if (token == Lexer::T_STRING) {
 		delete[] value.string;
 	}
+	delete objects;
 	return 0;
 }
 
 
+template BasicObjects<float> *loadData<float>(const char *filename);
+template BasicObjects<double> *loadData<double>(const char *filename);
+template BasicObjects<long double> *
+loadData<long double>(const char *filename);
+
+
 }
 
 }
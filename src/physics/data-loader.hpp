@@ -22,12 +22,12 @@
 #include <stdexcept>
 #include <vector>
 
+#include "object.hpp"
+
 namespace mn {
 
 namespace physics {
 
-struct Object;
-
 /**
  * Loads objects speciication from a given file.
  *
@@ -35,7 +35,7 @@ struct Object;
  * a fairly simple syntax and it's grammar is:
  *
  * <pre>
- * input    : { factors | object }
+ * input    : { factors | force | object | cloud }
  *
  * factors  : "*" { factor }
  * factor   : "@"    NUMBER             // position factor
@@ -43,6 +43,9 @@ struct Object;
  *          | "mass" NUMBER             // mass     factor
  *          | "size" NUMBER             // size     factor
  *
+ * force    : "force" law [ NUMBER ]    // force law and softening
+ * law      : "newton" | "plummer" | "cutoff"
+ *
  * object   : STRING { attribute }
  * attribute: "@" NUMBER NUMBER NUMBER  // position
  *          | "x" NUMBER                // position (x)
@@ -55,12 +58,19 @@ struct Object;
  *          | "color" NUMBER NUMBER NUMBER
  *          | "texture" STRING
  *          | "light"
+ *
+ * cloud    : "cloud" NUMBER STRING NUMBER NUMBER  // tracers
  * </pre>
  *
  * Factors specify value that given properties will be multiplicated
  * by after being read.  This allow (for example) easy unit
  * conversion.
  *
+ * Force sets force law all objects interact with (see force::Law)
+ * and its softening length which is multiplied by position factor.
+ * By default Newton's law is used and pairs closer then 0.1 are
+ * ignored.  Softening length must be positive.
+ *
  * Object is defined by specifying it's name followed by its
  * properties.
  *
@@ -86,9 +96,23 @@ struct Object;
  * average color of the image is taken).  The light attribute, when
  * given, says that the object is a light source.
  *
+ * Cloud adds given number of tracers (see BasicObjects::addTracer())
+ * orbiting an object (which must be defined earlier) on circular
+ * orbits in a flat ring around it.  The ring lies in the x-z plane
+ * and the two numbers are its inner and outer radius which are
+ * multiplied by position factor.  Orbital velocities are calculated
+ * from the object's mass just like with <tt>auto</tt> velocity so the
+ * object's mass must be given before the cloud.
+ *
  * \param filename file name of the file with configuration.
+ * \return loaded objects or NULL on error.
  */
-Object *loadData(const char *filename);
+template<class T>
+BasicObjects<T> *loadData(const char *filename);
+
+inline Objects *loadData(const char *filename) {
+	return loadData<Objects::value_type>(filename);
+}
 
 }
 
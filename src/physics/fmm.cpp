@@ -0,0 +1,746 @@
+/*
+ * src/physics/fmm.cpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "fmm.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "octants.hpp"
+#include "thread-pool.hpp"
+
+
+namespace mn {
+
+namespace physics {
+
+
+/* Number of subtrees accelerations are calculated in.  It does not
+ * depend on number of threads since the walk starting at a subtree
+ * accepts different pairs of nodes than one starting at its parent
+ * would. */
+static const unsigned minTasks = 256;
+
+static const unsigned maxOrder = Fmm<double>::maxOrder;
+/** Number of multi-indices of degree up to maxOrder. */
+static const unsigned maxTerms =
+	(maxOrder + 1) * (maxOrder + 2) * (maxOrder + 3) / 6;
+
+
+namespace {
+
+/**
+ * Multi-indices (exponents of x, y and z) of expansion terms and
+ * lists of operations each expansion operator performs.  Terms are
+ * sorted by degree and so are the lists by the highest degree they
+ * involve, so operators of order p use prefixes of them.  The hot
+ * multipole to local operator has a separate list for each order.
+ */
+struct Tables {
+	struct Term {
+		unsigned char n[3], degree;
+		/**
+		 * First non-zero exponent; parent is the term with that
+		 * exponent decremented and grand the term with it decreased
+		 * by two (if it is at least two).
+		 */
+		unsigned char dir;
+		unsigned short parent, grand;
+	};
+
+	/** Adds coefficient * b[b] * c[c] to a[a]. */
+	struct Entry {
+		unsigned short a, b, c;
+		double coefficient;
+	};
+
+	std::vector<Term> terms;
+	/** Multipole to multipole, local to local and local to
+	 * acceleration (in direction b) operators. */
+	std::vector<Entry> m2m, l2l, l2p;
+	/** Number of entries of each list used by each order. */
+	unsigned m2mCount[maxOrder + 1], l2lCount[maxOrder + 1];
+	unsigned l2pCount[maxOrder + 1];
+	/** Multipole to local operator of each order; products M[n] * D[d]
+	 * summed into L[k] are m2l[m2lStart[k]] up to m2l[m2lStart[k + 1]]
+	 * (exclusive). */
+	struct Pair {
+		unsigned short n, d;
+	};
+	std::vector<Pair> m2l[maxOrder + 1];
+	std::vector<unsigned> m2lStart[maxOrder + 1];
+	/** (-1)^|n| and 1 / n! of each term. */
+	double sign[maxTerms], inverseFactorial[maxTerms];
+
+	Tables();
+
+	static unsigned count(unsigned order) {
+		return (order + 1) * (order + 2) * (order + 3) / 6;
+	}
+
+private:
+	unsigned short index[maxOrder + 1][maxOrder + 1][maxOrder + 1];
+
+	unsigned short find(unsigned a, unsigned b, unsigned c) const {
+		return index[a][b][c];
+	}
+	static void prefix(const std::vector<Entry> &entries,
+	                   const std::vector<unsigned char> &degrees,
+	                   unsigned *counts);
+};
+
+
+static double factorial(unsigned n) {
+	return n ? n * factorial(n - 1) : 1;
+}
+
+static double binomial(unsigned n, unsigned k) {
+	return factorial(n) / (factorial(k) * factorial(n - k));
+}
+
+
+Tables::Tables() {
+	for (unsigned degree = 0; degree <= maxOrder; ++degree) {
+		for (unsigned a = degree + 1; a--; ) {
+			for (unsigned b = degree - a + 1; b--; ) {
+				Term term;
+				term.n[0] = a;
+				term.n[1] = b;
+				term.n[2] = degree - a - b;
+				term.degree = degree;
+				index[a][b][degree - a - b] = terms.size();
+				terms.push_back(term);
+			}
+		}
+	}
+
+	for (unsigned t = 1; t < terms.size(); ++t) {
+		Term &term = terms[t];
+		unsigned n[3] = { term.n[0], term.n[1], term.n[2] };
+		term.dir = n[0] ? 0 : n[1] ? 1 : 2;
+		--n[term.dir];
+		term.parent = find(n[0], n[1], n[2]);
+		if (n[term.dir]) {
+			--n[term.dir];
+			term.grand = find(n[0], n[1], n[2]);
+		} else {
+			term.grand = 0;
+		}
+	}
+
+	std::vector<unsigned char> degrees;
+	const Entry none = { 0, 0, 0, 0 };
+
+	/* M[n] += M'[m] * d^(n-m) / (n-m)! */
+	for (unsigned n = 0; n < terms.size(); ++n) {
+		const unsigned char *const N = terms[n].n;
+		for (unsigned m = 0; m < terms.size(); ++m) {
+			const unsigned char *const M = terms[m].n;
+			if (M[0] > N[0] || M[1] > N[1] || M[2] > N[2]) continue;
+			Entry e = none;
+			e.a = n;
+			e.b = m;
+			e.c = find(N[0] - M[0], N[1] - M[1], N[2] - M[2]);
+			e.coefficient = 1;
+			m2m.push_back(e);
+			degrees.push_back(terms[n].degree);
+		}
+	}
+	prefix(m2m, degrees, m2mCount);
+	degrees.clear();
+
+	/* L[k] += (-1)^|n| / k! * M[n] * D[n+k]; pairs of each order are
+	 * grouped by k so that the sum can be kept in a register. */
+	for (unsigned order = 0; order <= maxOrder; ++order) {
+		m2lStart[order].push_back(0);
+		for (unsigned k = 0; k < count(order); ++k) {
+			const unsigned char *const K = terms[k].n;
+			for (unsigned n = 0; n < count(order - terms[k].degree); ++n) {
+				const unsigned char *const N = terms[n].n;
+				Pair pair;
+				pair.n = n;
+				pair.d = find(N[0] + K[0], N[1] + K[1], N[2] + K[2]);
+				m2l[order].push_back(pair);
+			}
+			m2lStart[order].push_back(m2l[order].size());
+		}
+	}
+
+	for (unsigned n = 0; n < terms.size(); ++n) {
+		const unsigned char *const N = terms[n].n;
+		sign[n] = terms[n].degree & 1 ? -1 : 1;
+		inverseFactorial[n] =
+			1 / (factorial(N[0]) * factorial(N[1]) * factorial(N[2]));
+	}
+
+	/* L'[k] += binomial(n, k) * L[n] * d^(n-k) */
+	for (unsigned n = 0; n < terms.size(); ++n) {
+		const unsigned char *const N = terms[n].n;
+		for (unsigned k = 0; k < terms.size(); ++k) {
+			const unsigned char *const K = terms[k].n;
+			if (K[0] > N[0] || K[1] > N[1] || K[2] > N[2]) continue;
+			Entry e = none;
+			e.a = k;
+			e.b = n;
+			e.c = find(N[0] - K[0], N[1] - K[1], N[2] - K[2]);
+			e.coefficient = binomial(N[0], K[0]) * binomial(N[1], K[1]) *
+				binomial(N[2], K[2]);
+			l2l.push_back(e);
+			degrees.push_back(terms[n].degree);
+		}
+	}
+	prefix(l2l, degrees, l2lCount);
+	degrees.clear();
+
+	/* a[i] += (q_i + 1) * L[q + e_i] * x^q */
+	for (unsigned q = 0; q < terms.size(); ++q) {
+		if (terms[q].degree == maxOrder) continue;
+		const unsigned char *const Q = terms[q].n;
+		for (unsigned i = 0; i < 3; ++i) {
+			unsigned n[3] = { Q[0], Q[1], Q[2] };
+			++n[i];
+			Entry e = none;
+			e.a = find(n[0], n[1], n[2]);
+			e.b = i;
+			e.c = q;
+			e.coefficient = n[i];
+			l2p.push_back(e);
+			degrees.push_back(terms[q].degree + 1);
+		}
+	}
+	prefix(l2p, degrees, l2pCount);
+}
+
+
+void Tables::prefix(const std::vector<Entry> &entries,
+                    const std::vector<unsigned char> &degrees,
+                    unsigned *counts) {
+	for (unsigned order = 0; order <= maxOrder; ++order) {
+		counts[order] = 0;
+		while (counts[order] < entries.size() &&
+		       degrees[counts[order]] <= order) {
+			++counts[order];
+		}
+	}
+}
+
+
+static const Tables &tables() {
+	static const Tables tables;
+	return tables;
+}
+
+
+/**
+ * Calculates d^n for all multi-indices n of first \a terms terms,
+ * divided by n! if \a scaled is set.
+ */
+template<class T>
+static void monomials(const gl::Vector<T> &d, unsigned terms, bool scaled,
+                      T *out) {
+	const std::vector<Tables::Term> &t = tables().terms;
+	const T v[3] = { d.x, d.y, d.z };
+	out[0] = 1;
+	for (unsigned n = 1; n < terms; ++n) {
+		const Tables::Term &term = t[n];
+		out[n] = out[term.parent] * v[term.dir];
+		if (scaled) {
+			out[n] /= term.n[term.dir];
+		}
+	}
+}
+
+}
+
+
+template<class T>
+void Fmm<T>::build(const value_type *x, const value_type *y,
+                   const value_type *z, const value_type *masses,
+                   unsigned count) {
+	key = 0;
+	nodes.clear();
+	levels.clear();
+	index.clear();
+	++builds;
+
+	if (!count) {
+		px.clear(); py.clear(); pz.clear(); pm.clear();
+		return;
+	}
+
+	Vector min(x[0], y[0], z[0]), max = min;
+	index.resize(count);
+	for (unsigned i = 0; i < count; ++i) {
+		index[i] = i;
+		min.x = std::min(min.x, x[i]); max.x = std::max(max.x, x[i]);
+		min.y = std::min(min.y, y[i]); max.y = std::max(max.y, y[i]);
+		min.z = std::min(min.z, z[i]); max.z = std::max(max.z, z[i]);
+	}
+
+	const Vector size = max - min;
+	Node root;
+	root.cube = (min + max) * 0.5;
+	root.half = std::max(std::max(size.x, size.y), size.z) * 0.5 + 0.5;
+	root.first = 0;
+	root.count = count;
+	nodes.push_back(root);
+
+	/* Children are kept next to each other. */
+	octants::build(levels,
+	               [&](unsigned node, unsigned depth, unsigned *counts) {
+		splitNode(node, depth, x, y, z, counts);
+	}, [this](unsigned node, const unsigned *counts,
+	          std::vector<unsigned> &next) {
+		const Vector center = nodes[node].cube;
+		const value_type half = nodes[node].half * 0.5;
+		unsigned start = nodes[node].first;
+		nodes[node].child = nodes.size();
+
+		for (unsigned o = 0; o < 8; start += counts[o++]) {
+			if (!counts[o]) continue;
+
+			Node child;
+			child.cube = octants::center(center, half, o);
+			child.half = half;
+			child.first = start;
+			child.count = counts[o];
+			next.push_back(nodes.size());
+			nodes.push_back(child);
+			++nodes[node].children;
+		}
+	});
+
+	ThreadPool *const pool = ThreadPool::pool();
+	px.resize(count); py.resize(count); pz.resize(count); pm.resize(count);
+	pool->run(count, [&](unsigned begin, unsigned end) {
+		for (unsigned i = begin; i < end; ++i) {
+			px[i] = x[index[i]];
+			py[i] = y[index[i]];
+			pz[i] = z[index[i]];
+			pm[i] = masses[index[i]];
+		}
+	});
+
+	/* Deeper nodes first so that children are ready before their
+	 * parents. */
+	builtSize = 0;
+	for (unsigned d = levels.size(); d--; ) {
+		const std::vector<unsigned> &level = levels[d];
+		pool->run(level.size(), [this, &level](unsigned begin, unsigned end) {
+			for (unsigned i = begin; i < end; ++i) {
+				fit(level[i], true);
+			}
+		});
+		for (unsigned k = 0; k < level.size(); ++k) {
+			builtSize += nodes[level[k]].radius;
+		}
+	}
+}
+
+
+template<class T>
+void Fmm<T>::splitNode(unsigned node, unsigned depth, const value_type *x,
+                       const value_type *y, const value_type *z,
+                       unsigned *counts) {
+	const unsigned first = nodes[node].first, count = nodes[node].count;
+	nodes[node].child = nodes[node].children = 0;
+
+	if (count <= leafSize || depth >= octants::maxDepth) {
+		return;
+	}
+
+	const Vector center = nodes[node].cube;
+	const unsigned *const k = &index[first];
+	std::vector<unsigned> order;
+	octants::sort(count, [x, y, z, k, &center](unsigned i) {
+		return octants::octant(x[k[i]], y[k[i]], z[k[i]], center);
+	}, counts, order);
+	octants::permute(&index[first], order);
+}
+
+
+template<class T>
+void Fmm<T>::fit(unsigned node, bool built) {
+	Node &n = nodes[node];
+	const unsigned first = n.first, count = n.count;
+
+	value_type mass = 0;
+	Vector moment(0, 0, 0);
+	if (n.children) {
+		for (unsigned c = n.child; c < n.child + n.children; ++c) {
+			mass += nodes[c].mass;
+			moment += nodes[c].center * nodes[c].mass;
+		}
+	} else {
+		for (unsigned i = first; i < first + count; ++i) {
+			if (pm[i] < force::minMass) continue;
+			mass += pm[i];
+			moment += Vector(px[i], py[i], pz[i]) * pm[i];
+		}
+	}
+	n.mass = mass;
+	n.center = mass > 0 ? moment / mass : n.cube;
+
+	/* Bodies of a freshly built node are inside of its cube which
+	 * gives another bound for the radius; after refit they need not
+	 * be. */
+	value_type radius = 0;
+	if (n.children) {
+		for (unsigned c = n.child; c < n.child + n.children; ++c) {
+			radius = std::max(radius, (nodes[c].center - n.center).length() +
+			                  nodes[c].radius);
+		}
+		if (built) {
+			radius = std::min(radius, (n.cube - n.center).length() +
+			                  n.half * (value_type)std::sqrt(3.0));
+		}
+	} else {
+		for (unsigned i = first; i < first + count; ++i) {
+			radius = std::max(radius,
+			                  (Vector(px[i], py[i], pz[i]) - n.center).length());
+		}
+	}
+	n.radius = radius;
+}
+
+
+template<class T>
+void Fmm<T>::update(const value_type *x, const value_type *y,
+                    const value_type *z, const value_type *masses,
+                    unsigned count, value_type tolerance,
+                    unsigned long long theKey) {
+	if (tolerance <= 0 || !theKey || theKey != key || nodes.empty() ||
+	    count != index.size()) {
+		build(x, y, z, masses, count);
+		key = theKey;
+		return;
+	}
+
+	ThreadPool *const pool = ThreadPool::pool();
+	pool->run(count, [&](unsigned begin, unsigned end) {
+		for (unsigned i = begin; i < end; ++i) {
+			px[i] = x[index[i]];
+			py[i] = y[index[i]];
+			pz[i] = z[index[i]];
+			pm[i] = masses[index[i]];
+		}
+	});
+
+	for (unsigned d = levels.size(); d--; ) {
+		const std::vector<unsigned> &level = levels[d];
+		pool->run(level.size(), [this, &level](unsigned begin, unsigned end) {
+			for (unsigned i = begin; i < end; ++i) {
+				fit(level[i], false);
+			}
+		});
+	}
+
+	value_type size = 0;
+	for (unsigned i = 0; i < nodes.size(); ++i) {
+		size += nodes[i].radius;
+	}
+	if (size > builtSize * (1 + tolerance)) {
+		build(x, y, z, masses, count);
+		key = theKey;
+	} else {
+		++refits;
+	}
+}
+
+
+template<class T>
+unsigned long long
+Fmm<T>::accelerations(unsigned theOrder, value_type theTheta, value_type G,
+                      force::Law theLaw, value_type theSoftening,
+                      kernel::Isa theIsa, bool theRsqrt,
+                      value_type *ax, value_type *ay, value_type *az) {
+	if (nodes.empty()) {
+		return 0;
+	}
+
+	order = theOrder < 1 ? 1 : theOrder > maxOrder ? maxOrder : theOrder;
+	terms = Tables::count(order);
+	theta = theTheta;
+	law = theLaw;
+	softening = theSoftening;
+	isa = theIsa;
+	rsqrt = theRsqrt;
+
+	const unsigned n = px.size();
+	multipoles.assign(nodes.size() * terms, 0);
+	locals.assign(nodes.size() * terms, 0);
+	tax.assign(n, 0);
+	tay.assign(n, 0);
+	taz.assign(n, 0);
+
+	/* Upward pass, level by level starting from the deepest one so
+	 * that children are ready before their parents. */
+	ThreadPool *const pool = ThreadPool::pool();
+	for (unsigned d = levels.size(); d--; ) {
+		const std::vector<unsigned> &level = levels[d];
+		pool->run(level.size(), [this, &level](unsigned begin, unsigned end) {
+			for (unsigned i = begin; i < end; ++i) {
+				upward(level[i]);
+			}
+		});
+	}
+
+	/* Each thread takes whole subtrees: it gathers everything acting
+	 * on bodies of the subtree with a walk starting at the root and
+	 * then runs downward pass inside of the subtree. */
+	std::vector<unsigned> tasks(1, 0), next;
+	while (tasks.size() < minTasks) {
+		next.clear();
+		for (unsigned k = 0; k < tasks.size(); ++k) {
+			const Node &node = nodes[tasks[k]];
+			if (!node.children) {
+				next.push_back(tasks[k]);
+			}
+			for (unsigned c = node.child; c < node.child + node.children; ++c) {
+				next.push_back(c);
+			}
+		}
+		if (next.size() == tasks.size()) {
+			break;
+		}
+		tasks.swap(next);
+	}
+
+	std::atomic<unsigned long long> interactions(0);
+	force::dispatch<T>(law, softening, [&](const auto &gravity) {
+		pool->run(tasks.size(), [&](unsigned begin, unsigned end) {
+			unsigned long long count = 0;
+			for (unsigned k = begin; k < end; ++k) {
+				interact(gravity, tasks[k], 0, count);
+				downward(tasks[k], G, ax, ay, az);
+			}
+			interactions += count;
+		});
+	});
+	return interactions;
+}
+
+
+template<class T>
+void Fmm<T>::upward(unsigned node) {
+	const Tables &t = tables();
+	const Node &n = nodes[node];
+	value_type *const M = &multipoles[node * terms];
+	value_type mono[maxTerms];
+
+	if (!n.children) {
+		for (unsigned i = n.first; i < n.first + n.count; ++i) {
+			if (pm[i] < force::minMass) continue;
+			monomials(Vector(px[i], py[i], pz[i]) - n.center, terms, true,
+			          mono);
+			for (unsigned k = 0; k < terms; ++k) {
+				M[k] += pm[i] * mono[k];
+			}
+		}
+		return;
+	}
+
+	for (unsigned c = n.child; c < n.child + n.children; ++c) {
+		if (!(nodes[c].mass > 0)) continue;
+		const value_type *const C = &multipoles[c * terms];
+		monomials(nodes[c].center - n.center, terms, true, mono);
+		for (unsigned e = 0; e < t.m2mCount[order]; ++e) {
+			const Tables::Entry &entry = t.m2m[e];
+			M[entry.a] += C[entry.b] * mono[entry.c];
+		}
+	}
+}
+
+
+template<class T>
+template<class Force>
+void Fmm<T>::interact(const Force &gravity, unsigned target,
+                      unsigned source, unsigned long long &interactions) {
+	const Node &a = nodes[target], &b = nodes[source];
+	if (!(b.mass > 0)) {
+		return;
+	}
+
+	if (target == source) {
+		if (!a.children) {
+			direct(a, a);
+			interactions += (unsigned long long)a.count * (a.count - 1);
+			return;
+		}
+		for (unsigned i = a.child; i < a.child + a.children; ++i) {
+			for (unsigned j = a.child; j < a.child + a.children; ++j) {
+				interact(gravity, i, j, interactions);
+			}
+		}
+		return;
+	}
+
+	/* With NEWTON and CUTOFF laws expansions are valid only if no
+	 * pair of bodies is closer then the softening length. */
+	const value_type l = (a.center - b.center).length();
+	const value_type sum = a.radius + b.radius;
+	if (sum < theta * l &&
+	    (law == force::PLUMMER || l - sum >= softening)) {
+		multipoleToLocal(gravity, a, b, &locals[target * terms],
+		                 &multipoles[source * terms]);
+		++interactions;
+	} else if (!a.children && !b.children) {
+		direct(a, b);
+		interactions += (unsigned long long)a.count * b.count;
+	} else if (!b.children || (a.children && a.radius > b.radius)) {
+		for (unsigned i = a.child; i < a.child + a.children; ++i) {
+			interact(gravity, i, source, interactions);
+		}
+	} else {
+		for (unsigned j = b.child; j < b.child + b.children; ++j) {
+			interact(gravity, target, j, interactions);
+		}
+	}
+}
+
+
+template<class T>
+template<class Force>
+void Fmm<T>::multipoleToLocal(const Force &gravity, const Node &target,
+                              const Node &source, value_type *L,
+                              const value_type *M) {
+	const Tables &t = tables();
+	const Vector r = target.center - source.center;
+	const value_type v[3] = { 2 * r.x, 2 * r.y, 2 * r.z };
+
+	/* Derivatives of f(s) = s^-1/2 where s is softened squared
+	 * distance; since ds/dx = 2x, derivatives D[m] of f^(m) satisfy
+	 * D[m][n + e_i] = 2 x_i D[m+1][n] + 2 n_i D[m+1][n - e_i]. */
+	value_type D[maxOrder + 1][maxTerms];
+	const value_type s = gravity.soften(r.length2());
+	D[0][0] = 1 / std::sqrt(s);
+	for (unsigned m = 0; m < order; ++m) {
+		D[m + 1][0] = D[m][0] * -(value_type)(2 * m + 1) / (2 * s);
+	}
+	for (unsigned n = 1; n < terms; ++n) {
+		const Tables::Term &term = t.terms[n];
+		const value_type c = 2 * (term.n[term.dir] - 1);
+		for (unsigned m = 0; m + term.degree <= order; ++m) {
+			D[m][n] = v[term.dir] * D[m + 1][term.parent];
+			if (c) {
+				D[m][n] += c * D[m + 1][term.grand];
+			}
+		}
+	}
+
+	value_type signedM[maxTerms];
+	for (unsigned n = 0; n < terms; ++n) {
+		signedM[n] = (value_type)t.sign[n] * M[n];
+	}
+
+	const Tables::Pair *const pairs = &t.m2l[order][0];
+	const unsigned *const start = &t.m2lStart[order][0];
+	for (unsigned k = 0; k < terms; ++k) {
+		value_type sum = 0;
+		for (unsigned e = start[k]; e < start[k + 1]; ++e) {
+			sum += signedM[pairs[e].n] * D[0][pairs[e].d];
+		}
+		L[k] += sum * (value_type)t.inverseFactorial[k];
+	}
+}
+
+
+template<class T>
+void Fmm<T>::direct(const Node &target, const Node &source) {
+	static thread_local std::vector<value_type> a;
+	const unsigned n = target.count;
+	a.resize(3 * n);
+
+	kernel::accelerations(isa, rsqrt, law, softening,
+	                      &px[source.first], &py[source.first],
+	                      &pz[source.first], &pm[source.first], source.count,
+	                      &px[target.first], &py[target.first],
+	                      &pz[target.first], n, &a[0], &a[n], &a[2 * n]);
+	for (unsigned i = 0; i < n; ++i) {
+		tax[target.first + i] += a[i];
+		tay[target.first + i] += a[n + i];
+		taz[target.first + i] += a[2 * n + i];
+	}
+}
+
+
+template<class T>
+void Fmm<T>::downward(unsigned node, value_type G, value_type *ax,
+                      value_type *ay, value_type *az) {
+	const Tables &t = tables();
+	const Node &n = nodes[node];
+	const value_type *const L = &locals[node * terms];
+	value_type mono[maxTerms];
+
+	if (n.children) {
+		for (unsigned c = n.child; c < n.child + n.children; ++c) {
+			value_type *const C = &locals[c * terms];
+			monomials(nodes[c].center - n.center, terms, false, mono);
+			for (unsigned e = 0; e < t.l2lCount[order]; ++e) {
+				const Tables::Entry &entry = t.l2l[e];
+				C[entry.a] += (value_type)entry.coefficient * L[entry.b] *
+					mono[entry.c];
+			}
+			downward(c, G, ax, ay, az);
+		}
+		return;
+	}
+
+	for (unsigned i = n.first; i < n.first + n.count; ++i) {
+		monomials(Vector(px[i], py[i], pz[i]) - n.center, terms, false,
+		          mono);
+		value_type a[3] = { tax[i], tay[i], taz[i] };
+		for (unsigned e = 0; e < t.l2pCount[order]; ++e) {
+			const Tables::Entry &entry = t.l2p[e];
+			a[entry.b] += (value_type)entry.coefficient * L[entry.a] *
+				mono[entry.c];
+		}
+		ax[index[i]] = a[0] * G;
+		ay[index[i]] = a[1] * G;
+		az[index[i]] = a[2] * G;
+	}
+}
+
+
+template<class V>
+static unsigned long long bytes(const std::vector<V> &v) {
+	return v.capacity() * sizeof(V);
+}
+
+template<class T>
+unsigned long long Fmm<T>::memoryUsage() const {
+	unsigned long long total = bytes(nodes) + bytes(levels) + bytes(px) +
+		bytes(py) + bytes(pz) + bytes(pm) + bytes(index) +
+		bytes(multipoles) + bytes(locals) + bytes(tax) + bytes(tay) +
+		bytes(taz);
+	for (unsigned d = 0; d < levels.size(); ++d) {
+		total += bytes(levels[d]);
+	}
+	return total;
+}
+
+
+
+template struct Fmm<float>;
+template struct Fmm<double>;
+template struct Fmm<long double>;
+
+
+}
+
+}
@@ -0,0 +1,213 @@
+/*
+ * src/physics/fmm.hpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef H_FMM_HPP
+#define H_FMM_HPP
+
+#include <vector>
+
+#include "../common/vector.hpp"
+#include "force.hpp"
+#include "kernel.hpp"
+
+
+namespace mn {
+
+namespace physics {
+
+
+/**
+ * Fast multipole method.  Bodies are put in an octree and gravity of
+ * each node is expanded into a Cartesian Taylor series (multipole
+ * expansion) around node's centre of mass in an upward pass.  Pairs
+ * of nodes far enough from each other interact by converting
+ * multipole expansion of one into local expansion of the other; the
+ * pairs are found by a dual tree walk.  A downward pass shifts local
+ * expansions to children and evaluates them in bodies while bodies
+ * of nearby leaves interact directly using vectorised kernel (see
+ * kernel::accelerations()).  Cost is O(N) for a given order.
+ *
+ * Order p means expansions include terms of total degree up to p and
+ * gives accelerations of order p - 1; error falls roughly like
+ * theta^p.  Softened force laws are expanded just like Newton's law
+ * though NEWTON and CUTOFF laws need the nodes to be further apart
+ * then the softening length.
+ *
+ * Instantiated for float, double and long double.
+ */
+template<class T>
+struct Fmm {
+	typedef gl::Vector<T> Vector;
+	typedef T value_type;
+
+	/** Highest supported expansion order. */
+	static const unsigned maxOrder = 8;
+	/** Maximal number of bodies kept in a single leaf. */
+	static const unsigned leafSize = 64;
+
+	/**
+	 * Builds the tree.  All bodies get accelerations but bodies with
+	 * mass lower then force::minMass cause none (just like direct
+	 * summation).
+	 *
+	 * \param x x coordinates of bodies.
+	 * \param y y coordinates of bodies.
+	 * \param z z coordinates of bodies.
+	 * \param masses masses of bodies.
+	 * \param count number of bodies.
+	 */
+	void build(const value_type *x, const value_type *y,
+	           const value_type *z, const value_type *masses,
+	           unsigned count);
+
+	/**
+	 * Updates the tree after bodies moved.  If number of bodies did
+	 * not change, keeps the structure and refits it: centres of mass,
+	 * masses and radii of nodes are recalculated bottom-up in O(N)
+	 * (multipole expansions are calculated by accelerations() anyway).
+	 * If sum of radii exceeds the sum at the time of building by more
+	 * than \a tolerance times, the tree is built from scratch instead.
+	 *
+	 * \param x x coordinates of bodies.
+	 * \param y y coordinates of bodies.
+	 * \param z z coordinates of bodies.
+	 * \param masses masses of bodies.
+	 * \param count number of bodies.
+	 * \param tolerance allowed relative growth of the tree; if not
+	 *        positive tree is always built from scratch.
+	 * \param key identifies the bodies and their order; tree is
+	 *        refitted only if it equals non-zero key given to the
+	 *        previous update() since then the tree was built.
+	 */
+	void update(const value_type *x, const value_type *y,
+	            const value_type *z, const value_type *masses,
+	            unsigned count, value_type tolerance,
+	            unsigned long long key);
+
+	/** Returns how many times tree was built from scratch. */
+	unsigned long long getBuilds() const { return builds; }
+	/** Returns how many times tree was refitted by update(). */
+	unsigned long long getRefits() const { return refits; }
+
+	/**
+	 * Calculates accelerations of all bodies.  Work is split among
+	 * threads of ThreadPool.
+	 *
+	 * \param order expansion order, from 1 to #maxOrder.
+	 * \param theta opening angle; two nodes interact through their
+	 *        expansions if sum of their radii is less then theta times
+	 *        distance between their centres.  Must be less then one.
+	 * \param G gravitational constant.
+	 * \param law force law.
+	 * \param softening softening length of the law.
+	 * \param isa instruction set of the kernel used for nearby bodies.
+	 * \param rsqrt whether the kernel uses approximate reciprocal
+	 *        square root.
+	 * \param ax array to save x coordinates of accelerations to.
+	 * \param ay array to save y coordinates of accelerations to.
+	 * \param az array to save z coordinates of accelerations to; all
+	 *        three are indexed just like bodies passed to build().
+	 * \return number of pairs of nodes which interacted through
+	 *         expansions plus number of pairs of bodies whose
+	 *         interaction was summed directly.
+	 */
+	unsigned long long accelerations(unsigned order, value_type theta,
+	                                 value_type G, force::Law law,
+	                                 value_type softening, kernel::Isa isa,
+	                                 bool rsqrt, value_type *ax,
+	                                 value_type *ay, value_type *az);
+
+	bool empty() const { return nodes.empty(); }
+
+	Fmm() : builtSize(0), builds(0), refits(0), key(0) { }
+
+	/** Returns number of bytes allocated for the tree and expansions. */
+	unsigned long long memoryUsage() const;
+
+private:
+	struct Node {
+		/** Expansion centre; centre of mass unless node is massless. */
+		Vector center;
+		/** Centre of node's cube. */
+		Vector cube;
+		value_type half;
+		/** Total mass of bodies heavier then force::minMass. */
+		value_type mass;
+		/** Distance from expansion centre to the farthest body. */
+		value_type radius;
+		/** Range of bodies in the tree's body arrays. */
+		unsigned first, count;
+		/** Index of the first child and number of children. */
+		unsigned child, children;
+	};
+
+	std::vector<Node> nodes;
+	/** Nodes at each depth; used to run upward pass level by level. */
+	std::vector<std::vector<unsigned> > levels;
+	/** Bodies in tree order and their indexes passed to build(). */
+	std::vector<value_type> px, py, pz, pm;
+	std::vector<unsigned> index;
+	/** Coefficients of expansions, #terms per node. */
+	std::vector<value_type> multipoles, locals;
+	/** Accelerations of bodies in tree order (not multiplied by G). */
+	std::vector<value_type> tax, tay, taz;
+	/** Sum of radii of nodes after build. */
+	value_type builtSize;
+	unsigned long long builds, refits;
+	/** Key given to the last update() or zero after build(). */
+	unsigned long long key;
+
+	/** Parameters of current accelerations() call. */
+	unsigned order, terms;
+	value_type theta, softening;
+	force::Law law;
+	kernel::Isa isa;
+	bool rsqrt;
+
+	/**
+	 * Sorts bodies of a node by octant unless it is a leaf.
+	 * \param counts array of eight zeros to save number of bodies in
+	 *        each octant to; left intact for leaves.
+	 */
+	void splitNode(unsigned node, unsigned depth, const value_type *x,
+	               const value_type *y, const value_type *z,
+	               unsigned *counts);
+	void fit(unsigned node, bool built);
+	void upward(unsigned node);
+	template<class Force>
+	void interact(const Force &gravity, unsigned target, unsigned source,
+	              unsigned long long &interactions);
+	template<class Force>
+	void multipoleToLocal(const Force &gravity, const Node &target,
+	                      const Node &source, value_type *local,
+	                      const value_type *multipole);
+	void direct(const Node &target, const Node &source);
+	void downward(unsigned node, value_type G, value_type *ax,
+	              value_type *ay, value_type *az);
+};
+
+
+extern template struct Fmm<float>;
+extern template struct Fmm<double>;
+extern template struct Fmm<long double>;
+
+
+}
+
+}
+
+#endif
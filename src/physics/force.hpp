@@ -0,0 +1,139 @@
+/*
+ * src/physics/force.hpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef H_FORCE_HPP
+#define H_FORCE_HPP
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace mn {
+
+namespace physics {
+
+
+/**
+ * Force laws.  Each law is defined by a softening length which
+ * replaces the old rule of skipping pairs closer then 0.1.  Loops
+ * calculating forces are templates taking a Force as argument so
+ * that law is chosen once per loop rather then once per pair.
+ */
+namespace force {
+
+
+/** Sources lighter then this cause no forces whatever the law. */
+static const double minMass = 0.01;
+
+
+enum Law {
+	/**
+	 * Newton's law of gravity; pairs closer then softening length
+	 * are ignored.
+	 */
+	NEWTON,
+	/**
+	 * Plummer softening: squared softening length is added to
+	 * squared distance so force is finite and smooth everywhere.
+	 */
+	PLUMMER,
+	/**
+	 * Newton's law outside of softening length; inside, force grows
+	 * linearly with distance like inside of a homogeneous sphere.
+	 */
+	CUTOFF
+};
+
+/** Returns user readable name of a law. */
+inline const char *name(Law law) {
+	static const char *const names[] = { "newton", "plummer", "cutoff" };
+	return names[law];
+}
+
+
+/**
+ * Force between two point masses under given law.  All methods take
+ * squared distance between the points.
+ */
+template<class T, Law law>
+struct Force {
+	explicit Force(T softening) : soft2(softening * softening) { }
+
+	/** Whether pair causes no force at all. */
+	bool skip(T l2) const { return law == NEWTON && l2 < soft2; }
+
+	/**
+	 * Returns squared distance to use in place of l2 when calculating
+	 * the force.
+	 */
+	T soften(T l2) const {
+		return law == PLUMMER ? l2 + soft2
+			: law == CUTOFF ? std::max(l2, soft2) : l2;
+	}
+
+	/**
+	 * Returns f such that acceleration caused by unit mass at
+	 * separation vector r is f * r.
+	 */
+	T factor(T l2) const {
+		const T s = soften(l2);
+		return 1 / (s * std::sqrt(s));
+	}
+
+	/**
+	 * Returns k such that derivative of f * r in time when the points
+	 * move with relative velocity w is f * (w - k * (r . w) * r).
+	 */
+	T jerk(T l2) const {
+		return law == CUTOFF && l2 < soft2 ? 0 : 3 / soften(l2);
+	}
+
+	/** Potential energy of two unit masses. */
+	T potential(T l2) const {
+		if (law == CUTOFF && l2 < soft2) {
+			const T r = std::sqrt(soft2);
+			return (l2 - 3 * soft2) / (2 * soft2 * r);
+		}
+		return -1 / std::sqrt(soften(l2));
+	}
+
+	T soft2;
+};
+
+
+/**
+ * Calls body with Force object for given law.
+ * \return value body returns.
+ */
+template<class T, class Body>
+inline auto dispatch(Law law, T softening, Body body)
+	-> decltype(body(Force<T, NEWTON>(softening))) {
+	switch (law) {
+	case PLUMMER: return body(Force<T, PLUMMER>(softening));
+	case CUTOFF:  return body(Force<T, CUTOFF>(softening));
+	default:      return body(Force<T, NEWTON>(softening));
+	}
+}
+
+
+}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,291 @@
+/*
+ * src/physics/frozen-field.cpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "frozen-field.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "kernel.hpp"
+#include "thread-pool.hpp"
+
+
+namespace mn {
+
+namespace physics {
+
+
+template<class T>
+void FrozenField<T>::build(const value_type *x, const value_type *y,
+                           const value_type *z, const value_type *masses,
+                           const unsigned char *frozen, unsigned count,
+                           unsigned cells, value_type theG,
+                           force::Law theLaw, value_type theSoftening) {
+	sx.clear(); sy.clear(); sz.clear(); sm.clear();
+	grid.clear();
+	first.clear();
+	bucketed.clear();
+	G = theG;
+	law = theLaw;
+	softening = theSoftening;
+
+	if (!count) {
+		return;
+	}
+
+	Vector min(x[0], y[0], z[0]), max = min;
+	for (unsigned i = 0; i < count; ++i) {
+		min.x = std::min(min.x, x[i]); max.x = std::max(max.x, x[i]);
+		min.y = std::min(min.y, y[i]); max.y = std::max(max.y, y[i]);
+		min.z = std::min(min.z, z[i]); max.z = std::max(max.z, z[i]);
+		if (frozen[i] && masses[i] >= force::minMass) {
+			sx.push_back(x[i]);
+			sy.push_back(y[i]);
+			sz.push_back(z[i]);
+			sm.push_back(masses[i]);
+		}
+	}
+
+	if (sx.empty()) {
+		return;
+	}
+
+	/* Leave some room for moving objects; those which get outside of
+	 * the grid anyway are dealt with by exact sums. */
+	const Vector size = max - min;
+	const value_type longest = std::max(std::max(size.x, size.y), size.z);
+	const value_type pad = longest / 4 + 0.5;
+	step = (longest + 2 * pad) / std::max(cells, 1u);
+
+	/* Near part must cover the softening length so that far part is
+	 * never skipped by NEWTON law. */
+	const value_type range = std::max(nearCells * step, softening);
+	near2 = range * range;
+	bucketWidth = range;
+
+	/* Inside of the near range, far part of the force is r * (a + b l2
+	 * + c l2^2) with coefficients chosen so that it has continuous
+	 * second derivatives; with a simple cut off interpolation would
+	 * be inaccurate next to the edge of the range.  All
+	 * laws give 1 / (s * sqrt(s)) where s = soften(l2) on the edge
+	 * and derivative of soften(l2) is one there. */
+	force::dispatch<T>(law, softening, [this](const auto &gravity) {
+		const value_type s = gravity.soften(near2);
+		const value_type f = 1 / (s * std::sqrt(s));
+		const value_type d1 = -1.5 * f / s, d2 = 3.75 * f / (s * s);
+		farC = d2 / 2;
+		farB = d1 - d2 * near2;
+		farA = f - near2 * (farB + near2 * farC);
+	});
+
+	/* Grid is centred on the objects so that symmetric configurations
+	 * get symmetric field. */
+	const value_type extent[3] = {
+		size.x + 2 * pad, size.y + 2 * pad, size.z + 2 * pad
+	};
+	for (unsigned d = 0; d < 3; ++d) {
+		nodes[d] = (unsigned)std::ceil(extent[d] / step) + 1;
+		buckets[d] = (unsigned)((nodes[d] - 1) * step / bucketWidth) + 1;
+	}
+	origin = (min + max) / 2 -
+		Vector(nodes[0] - 1, nodes[1] - 1, nodes[2] - 1) * (step / 2);
+
+	/* Counting sort of sources into buckets. */
+	const unsigned n = sx.size();
+	std::vector<unsigned> bucket(n);
+	first.assign(buckets[0] * buckets[1] * buckets[2] + 1, 0);
+	for (unsigned k = 0; k < n; ++k) {
+		const unsigned bx = (unsigned)((sx[k] - origin.x) / bucketWidth);
+		const unsigned by = (unsigned)((sy[k] - origin.y) / bucketWidth);
+		const unsigned bz = (unsigned)((sz[k] - origin.z) / bucketWidth);
+		bucket[k] = (bz * buckets[1] + by) * buckets[0] + bx;
+		++first[bucket[k] + 1];
+	}
+	for (unsigned b = 1; b < first.size(); ++b) {
+		first[b] += first[b - 1];
+	}
+	bucketed.resize(n);
+	{
+		std::vector<unsigned> next(first.begin(), first.end() - 1);
+		for (unsigned k = 0; k < n; ++k) {
+			bucketed[next[bucket[k]]++] = k;
+		}
+	}
+
+	grid.resize(nodes[0] * nodes[1] * nodes[2]);
+	force::dispatch<T>(law, softening, [this](const auto &gravity) {
+		sampleAll(gravity);
+	});
+}
+
+
+template<class T>
+template<class Force>
+void FrozenField<T>::sampleAll(const Force &gravity) {
+	/* Far part is the whole force less the near part so the grid can
+	 * be filled quickly by the vectorised kernel. */
+	kernel::Isa isa;
+	kernel::parse("auto", isa);
+
+	ThreadPool::pool()->run(grid.size(), [&](unsigned begin, unsigned end) {
+		for (unsigned node = begin; node < end; ++node) {
+			const unsigned ix = node % nodes[0];
+			const unsigned iy = node / nodes[0] % nodes[1];
+			const unsigned iz = node / nodes[0] / nodes[1];
+			const Vector point = origin + Vector(ix, iy, iz) * step;
+
+			value_type a[3];
+			kernel::acceleration(isa, false, law, softening,
+			                     &sx[0], &sy[0], &sz[0], &sm[0], sx.size(),
+			                     point.x, point.y, point.z, a);
+			grid[node] = (Vector(a[0], a[1], a[2]) -
+			              near(gravity, point)) * G;
+		}
+	});
+}
+
+
+/**
+ * Calculates weights of cubic Lagrange interpolation in nodes -1, 0,
+ * 1 and 2 of a point at \a t between nodes 0 and 1.
+ */
+template<class T>
+static void weights(T t, T w[4]) {
+	const T a = t + 1, b = t - 1, c = t - 2;
+	w[0] = -t * b * c / 6;
+	w[1] = a * b * c / 2;
+	w[2] = -a * t * c / 2;
+	w[3] = a * t * b / 6;
+}
+
+
+template<class T>
+typename FrozenField<T>::Vector
+FrozenField<T>::acceleration(const Vector &point) const {
+	if (sx.empty()) {
+		return Vector(0, 0, 0);
+	}
+	return force::dispatch<T>(law, softening, [&](const auto &gravity) {
+		return acceleration(gravity, point);
+	});
+}
+
+
+template<class T>
+template<class Force>
+typename FrozenField<T>::Vector
+FrozenField<T>::acceleration(const Force &gravity,
+                             const Vector &point) const {
+	const Vector u = (point - origin) / step;
+
+	if (!(u.x >= 1 && u.x < nodes[0] - 2 &&
+	      u.y >= 1 && u.y < nodes[1] - 2 &&
+	      u.z >= 1 && u.z < nodes[2] - 2)) {
+		Vector a(0, 0, 0);
+		for (unsigned k = 0, n = sx.size(); k < n; ++k) {
+			const Vector r(sx[k] - point.x, sy[k] - point.y, sz[k] - point.z);
+			const value_type l2 = r.length2();
+			if (gravity.skip(l2)) continue;
+			a += r * (sm[k] * gravity.factor(l2));
+		}
+		return a * G;
+	}
+
+	/* Tricubic Lagrange interpolation of the far part from 4x4x4
+	 * nodes around the point. */
+	const unsigned ix = u.x, iy = u.y, iz = u.z;
+	value_type wx[4], wy[4], wz[4];
+	weights(u.x - ix, wx);
+	weights(u.y - iy, wy);
+	weights(u.z - iz, wz);
+
+	const unsigned dy = nodes[0], dz = nodes[0] * nodes[1];
+	const Vector *g = &grid[(iz - 1) * dz + (iy - 1) * dy + ix - 1];
+	Vector a(0, 0, 0);
+	for (unsigned k = 0; k < 4; ++k, g += dz - 4 * dy) {
+		Vector plane(0, 0, 0);
+		for (unsigned j = 0; j < 4; ++j, g += dy) {
+			plane += (g[0] * wx[0] + g[1] * wx[1] +
+			          g[2] * wx[2] + g[3] * wx[3]) * wy[j];
+		}
+		a += plane * wz[k];
+	}
+
+	return a + near(gravity, point) * G;
+}
+
+
+template<class T>
+template<class Force>
+typename FrozenField<T>::Vector
+FrozenField<T>::near(const Force &gravity, const Vector &point) const {
+	/* Buckets are as wide as the near range so the point's bucket and
+	 * its 26 neighbours need to be checked. */
+	const Vector v = (point - origin) / bucketWidth;
+	const unsigned b[3] = {
+		(unsigned)v.x, (unsigned)v.y, (unsigned)v.z
+	};
+	const unsigned lo[3] = {
+		b[0] ? b[0] - 1 : 0, b[1] ? b[1] - 1 : 0, b[2] ? b[2] - 1 : 0
+	};
+	const unsigned hi[3] = {
+		std::min(b[0] + 2, buckets[0]), std::min(b[1] + 2, buckets[1]),
+		std::min(b[2] + 2, buckets[2])
+	};
+
+	Vector a(0, 0, 0);
+	for (unsigned bz = lo[2]; bz < hi[2]; ++bz) {
+		for (unsigned by = lo[1]; by < hi[1]; ++by) {
+			const unsigned row = (bz * buckets[1] + by) * buckets[0];
+			const unsigned end = first[row + hi[0]];
+			for (unsigned j = first[row + lo[0]]; j < end; ++j) {
+				const unsigned k = bucketed[j];
+				const Vector r(sx[k] - point.x, sy[k] - point.y,
+				               sz[k] - point.z);
+				const value_type l2 = r.length2();
+				if (l2 >= near2) continue;
+				const value_type f = gravity.skip(l2) ? 0 : gravity.factor(l2);
+				a += r * (sm[k] * (f - farA - l2 * (farB + l2 * farC)));
+			}
+		}
+	}
+
+	return a;
+}
+
+
+template<class V>
+static unsigned long long bytes(const std::vector<V> &v) {
+	return v.capacity() * sizeof(V);
+}
+
+template<class T>
+unsigned long long FrozenField<T>::memoryUsage() const {
+	return bytes(sx) + bytes(sy) + bytes(sz) + bytes(sm) + bytes(grid) +
+		bytes(first) + bytes(bucketed);
+}
+
+
+
+template struct FrozenField<float>;
+template struct FrozenField<double>;
+template struct FrozenField<long double>;
+
+
+}
+
+}
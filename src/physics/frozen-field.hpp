@@ -0,0 +1,121 @@
+/*
+ * src/physics/frozen-field.hpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef H_FROZEN_FIELD_HPP
+#define H_FROZEN_FIELD_HPP
+
+#include <vector>
+
+#include "../common/vector.hpp"
+#include "force.hpp"
+
+
+namespace mn {
+
+namespace physics {
+
+
+/**
+ * Gravitational field of frozen objects sampled on a regular grid.
+ * Since frozen objects never move, their field is calculated once
+ * and then looked up in O(1) time instead of summing over all frozen
+ * objects for each moving object in each tick.
+ *
+ * Force of each frozen object is split in two.  Far part equals the
+ * force beyond #nearCells grid cells and is a smooth polynomial
+ * closer then that so it can be interpolated (tricubically) from the
+ * grid.  Near part, the difference between the force and the far
+ * part, is zero beyond that distance and is calculated exactly for
+ * the few frozen objects that close, found using a coarse grid of
+ * buckets.  Relative error of a single object's force is about 1e-3
+ * at the edge of the near range and falls quickly further away.
+ * Points outside of the grid get exact sum over all frozen objects.
+ *
+ * Instantiated for float, double and long double.
+ */
+template<class T>
+struct FrozenField {
+	typedef gl::Vector<T> Vector;
+	typedef T value_type;
+
+	/** Radius of the near part of the force in grid cells. */
+	static const unsigned nearCells = 6;
+
+	/**
+	 * Builds the grid.  Grid covers bounding box of all objects
+	 * enlarged by a quarter of its longest edge on each side.
+	 *
+	 * \param x x coordinates of objects.
+	 * \param y y coordinates of objects.
+	 * \param z z coordinates of objects.
+	 * \param masses masses of objects.
+	 * \param frozen whether objects are frozen; only frozen objects
+	 *        heavier then force::minMass are sources of the field.
+	 * \param count number of objects.
+	 * \param cells number of grid cells along longest edge.
+	 * \param G gravitational constant.
+	 * \param law force law.
+	 * \param softening softening length of the law.
+	 */
+	void build(const value_type *x, const value_type *y,
+	           const value_type *z, const value_type *masses,
+	           const unsigned char *frozen, unsigned count, unsigned cells,
+	           value_type G, force::Law law, value_type softening);
+
+	/** Returns acceleration caused by frozen objects in given point. */
+	Vector acceleration(const Vector &point) const;
+
+	/** Returns number of bytes allocated for the grid and sources. */
+	unsigned long long memoryUsage() const;
+
+private:
+	/** Positions and masses of frozen objects. */
+	std::vector<value_type> sx, sy, sz, sm;
+	/** Far part of the field in grid nodes, x changing fastest. */
+	std::vector<Vector> grid;
+	/** Sources in each bucket; those of bucket b start at first[b]. */
+	std::vector<unsigned> first, bucketed;
+
+	Vector origin;
+	value_type step, near2, bucketWidth;
+	/** Coefficients of far part of the force inside the near range. */
+	value_type farA, farB, farC;
+	unsigned nodes[3], buckets[3];
+	value_type G;
+	force::Law law;
+	value_type softening;
+
+	template<class Force>
+	Vector acceleration(const Force &gravity, const Vector &point) const;
+	/** Returns near part of the field (not multiplied by G). */
+	template<class Force>
+	Vector near(const Force &gravity, const Vector &point) const;
+	template<class Force>
+	void sampleAll(const Force &gravity);
+};
+
+
+extern template struct FrozenField<float>;
+extern template struct FrozenField<double>;
+extern template struct FrozenField<long double>;
+
+
+}
+
+}
+
+#endif
@@ -0,0 +1,973 @@
+/*
+ * src/physics/kernel.cpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "kernel.hpp"
+
+#include <string.h>
+
+#include <cmath>
+
+#include "force.hpp"
+
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+#  define MN_KERNEL_X86 1
+#  include <immintrin.h>
+#endif
+
+
+namespace mn {
+
+namespace physics {
+
+namespace kernel {
+
+
+bool supported(Isa isa) {
+	switch (isa) {
+	case SCALAR:
+		return true;
+#ifdef MN_KERNEL_X86
+	case AVX2:
+		return __builtin_cpu_supports("avx2") &&
+			__builtin_cpu_supports("fma");
+	case AVX512:
+		return __builtin_cpu_supports("avx512f");
+#endif
+	default:
+		return false;
+	}
+}
+
+Isa detect() {
+	return supported(AVX512) ? AVX512 : supported(AVX2) ? AVX2 : SCALAR;
+}
+
+const char *name(Isa isa) {
+	switch (isa) {
+	case SCALAR: return "scalar";
+	case AVX2:   return "avx2";
+	case AVX512: return "avx512";
+	default:     return "unknown";
+	}
+}
+
+bool parse(const char *str, Isa &isa) {
+	if (!strcmp(str, "auto")) {
+		isa = detect();
+		return true;
+	}
+
+	for (unsigned i = SCALAR; i <= AVX512; ++i) {
+		if (!strcmp(str, name((Isa)i))) {
+			isa = (Isa)i;
+			return supported(isa);
+		}
+	}
+	return false;
+}
+
+
+template<force::Law law, class T>
+static void accelerationScalar(const force::Force<T, law> &gravity,
+                               const T *x, const T *y, const T *z,
+                               const T *mass, unsigned count,
+                               T px, T py, T pz, T out[3]) {
+	T ax = 0, ay = 0, az = 0;
+	for (unsigned j = 0; j < count; ++j) {
+		if (mass[j] < (T)force::minMass) continue;
+		const T dx = x[j] - px, dy = y[j] - py, dz = z[j] - pz;
+		const T l2 = dx * dx + dy * dy + dz * dz;
+		if (gravity.skip(l2)) continue;
+		const T f = mass[j] * gravity.factor(l2);
+		ax += dx * f;
+		ay += dy * f;
+		az += dz * f;
+	}
+	out[0] = ax;
+	out[1] = ay;
+	out[2] = az;
+}
+
+template<force::Law law>
+static void accelerationScalarMixed(const force::Force<float, law> &gravity,
+                                    const double *x, const double *y,
+                                    const double *z, const double *mass,
+                                    unsigned count,
+                                    double px, double py, double pz,
+                                    double out[3]) {
+	double ax = 0, ay = 0, az = 0;
+	for (unsigned j = 0; j < count; ++j) {
+		if (mass[j] < force::minMass) continue;
+		const double dx = x[j] - px, dy = y[j] - py, dz = z[j] - pz;
+		const float fx = dx, fy = dy, fz = dz;
+		const float l2 = fx * fx + fy * fy + fz * fz;
+		if (gravity.skip(l2)) continue;
+		const double f = (float)mass[j] * gravity.factor(l2);
+		ax += dx * f;
+		ay += dy * f;
+		az += dz * f;
+	}
+	out[0] = ax;
+	out[1] = ay;
+	out[2] = az;
+}
+
+
+/**
+ * Point by point variant of the kernels below; used for tails which
+ * do not fill a whole vector and when no vector instructions are
+ * available.
+ */
+template<force::Law law, class T>
+static void accelerationsScalar(const force::Force<T, law> &gravity,
+                                const T *x, const T *y, const T *z,
+                                const T *mass, unsigned count,
+                                const T *px, const T *py, const T *pz,
+                                unsigned points, T *ax, T *ay, T *az) {
+	for (unsigned i = 0; i < points; ++i) {
+		T out[3];
+		accelerationScalar(gravity, x, y, z, mass, count,
+		                   px[i], py[i], pz[i], out);
+		ax[i] = out[0];
+		ay[i] = out[1];
+		az[i] = out[2];
+	}
+}
+
+
+#ifdef MN_KERNEL_X86
+
+__attribute__((target("avx2,fma")))
+static inline double sum(__m256d v) {
+	const __m128d h = _mm_add_pd(_mm256_castpd256_pd128(v),
+	                             _mm256_extractf128_pd(v, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+}
+
+template<force::Law law>
+__attribute__((target("avx2,fma")))
+static void accelerationAVX2(const force::Force<double, law> &gravity,
+                             bool rsqrt,
+                             const double *x, const double *y,
+                             const double *z, const double *mass,
+                             unsigned count,
+                             double px, double py, double pz,
+                             double out[3]) {
+	const __m256d vpx = _mm256_set1_pd(px);
+	const __m256d vpy = _mm256_set1_pd(py);
+	const __m256d vpz = _mm256_set1_pd(pz);
+	const __m256d min = _mm256_set1_pd(force::minMass);
+	const __m256d soft = _mm256_set1_pd(gravity.soft2);
+	const __m256d half = _mm256_set1_pd(0.5), threeHalfs = _mm256_set1_pd(1.5);
+	__m256d ax = _mm256_setzero_pd();
+	__m256d ay = _mm256_setzero_pd();
+	__m256d az = _mm256_setzero_pd();
+
+	unsigned j = 0;
+	for (; j + 4 <= count; j += 4) {
+		const __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x + j), vpx);
+		const __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y + j), vpy);
+		const __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(z + j), vpz);
+		const __m256d m = _mm256_loadu_pd(mass + j);
+		const __m256d l2 = _mm256_fmadd_pd(dx, dx, _mm256_fmadd_pd(
+			dy, dy, _mm256_mul_pd(dz, dz)));
+		const __m256d s = law == force::PLUMMER ? _mm256_add_pd(l2, soft)
+			: law == force::CUTOFF ? _mm256_max_pd(l2, soft) : l2;
+
+		__m256d inv3;
+		if (rsqrt) {
+			/* Single precision estimate (12 bits) refined twice
+			 * gives about 48 correct bits. */
+			__m256d r = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(s)));
+			const __m256d h = _mm256_mul_pd(half, s);
+			r = _mm256_mul_pd(r, _mm256_fnmadd_pd(h, _mm256_mul_pd(r, r), threeHalfs));
+			r = _mm256_mul_pd(r, _mm256_fnmadd_pd(h, _mm256_mul_pd(r, r), threeHalfs));
+			inv3 = _mm256_mul_pd(r, _mm256_mul_pd(r, r));
+		} else {
+			inv3 = _mm256_div_pd(_mm256_set1_pd(1),
+			                     _mm256_mul_pd(s, _mm256_sqrt_pd(s)));
+		}
+
+		const __m256d mask = _mm256_and_pd(
+			_mm256_cmp_pd(l2, soft,
+				law == force::NEWTON ? _CMP_GE_OQ : _CMP_TRUE_UQ),
+			_mm256_cmp_pd(m, min, _CMP_GE_OQ));
+		const __m256d f = _mm256_and_pd(mask, _mm256_mul_pd(m, inv3));
+		ax = _mm256_fmadd_pd(f, dx, ax);
+		ay = _mm256_fmadd_pd(f, dy, ay);
+		az = _mm256_fmadd_pd(f, dz, az);
+	}
+
+	accelerationScalar(gravity, x + j, y + j, z + j, mass + j, count - j,
+	                   px, py, pz, out);
+	out[0] += sum(ax);
+	out[1] += sum(ay);
+	out[2] += sum(az);
+}
+
+
+template<force::Law law>
+__attribute__((target("avx512f")))
+static void accelerationAVX512(const force::Force<double, law> &gravity,
+                               bool rsqrt,
+                               const double *x, const double *y,
+                               const double *z, const double *mass,
+                               unsigned count,
+                               double px, double py, double pz,
+                               double out[3]) {
+	const __m512d vpx = _mm512_set1_pd(px);
+	const __m512d vpy = _mm512_set1_pd(py);
+	const __m512d vpz = _mm512_set1_pd(pz);
+	const __m512d min = _mm512_set1_pd(force::minMass);
+	const __m512d soft = _mm512_set1_pd(gravity.soft2);
+	const __m512d half = _mm512_set1_pd(0.5), threeHalfs = _mm512_set1_pd(1.5);
+	__m512d ax = _mm512_setzero_pd();
+	__m512d ay = _mm512_setzero_pd();
+	__m512d az = _mm512_setzero_pd();
+
+	for (unsigned j = 0; j < count; j += 8) {
+		const __mmask8 tail = count - j >= 8
+			? 0xff : (__mmask8)((1u << (count - j)) - 1);
+		const __m512d m = _mm512_maskz_loadu_pd(tail, mass + j);
+		const __m512d dx = _mm512_sub_pd(_mm512_maskz_loadu_pd(tail, x + j), vpx);
+		const __m512d dy = _mm512_sub_pd(_mm512_maskz_loadu_pd(tail, y + j), vpy);
+		const __m512d dz = _mm512_sub_pd(_mm512_maskz_loadu_pd(tail, z + j), vpz);
+		const __m512d l2 = _mm512_fmadd_pd(dx, dx, _mm512_fmadd_pd(
+			dy, dy, _mm512_mul_pd(dz, dz)));
+		const __m512d s = law == force::PLUMMER ? _mm512_add_pd(l2, soft)
+			: law == force::CUTOFF ? _mm512_max_pd(l2, soft) : l2;
+
+		const __mmask8 mask = tail &
+			_mm512_cmp_pd_mask(l2, soft,
+				law == force::NEWTON ? _CMP_GE_OQ : _CMP_TRUE_UQ) &
+			_mm512_cmp_pd_mask(m, min, _CMP_GE_OQ);
+
+		__m512d inv3;
+		if (rsqrt) {
+			/* 14 bit estimate refined twice gives full precision. */
+			__m512d r = _mm512_rsqrt14_pd(s);
+			const __m512d h = _mm512_mul_pd(half, s);
+			r = _mm512_mul_pd(r, _mm512_fnmadd_pd(h, _mm512_mul_pd(r, r), threeHalfs));
+			r = _mm512_mul_pd(r, _mm512_fnmadd_pd(h, _mm512_mul_pd(r, r), threeHalfs));
+			inv3 = _mm512_mul_pd(r, _mm512_mul_pd(r, r));
+		} else {
+			inv3 = _mm512_div_pd(_mm512_set1_pd(1),
+			                     _mm512_mul_pd(s, _mm512_sqrt_pd(s)));
+		}
+
+		const __m512d f = _mm512_maskz_mul_pd(mask, m, inv3);
+		ax = _mm512_fmadd_pd(f, dx, ax);
+		ay = _mm512_fmadd_pd(f, dy, ay);
+		az = _mm512_fmadd_pd(f, dz, az);
+	}
+
+	out[0] = _mm512_reduce_add_pd(ax);
+	out[1] = _mm512_reduce_add_pd(ay);
+	out[2] = _mm512_reduce_add_pd(az);
+}
+
+
+__attribute__((target("avx2,fma")))
+static inline float sum(__m256 v) {
+	__m128 h = _mm_add_ps(_mm256_castps256_ps128(v),
+	                      _mm256_extractf128_ps(v, 1));
+	h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+	return _mm_cvtss_f32(_mm_add_ss(h, _mm_movehdup_ps(h)));
+}
+
+template<force::Law law>
+__attribute__((target("avx2,fma")))
+static void accelerationAVX2(const force::Force<float, law> &gravity,
+                             bool rsqrt,
+                             const float *x, const float *y,
+                             const float *z, const float *mass,
+                             unsigned count,
+                             float px, float py, float pz,
+                             float out[3]) {
+	const __m256 vpx = _mm256_set1_ps(px);
+	const __m256 vpy = _mm256_set1_ps(py);
+	const __m256 vpz = _mm256_set1_ps(pz);
+	const __m256 min = _mm256_set1_ps(force::minMass);
+	const __m256 soft = _mm256_set1_ps(gravity.soft2);
+	const __m256 half = _mm256_set1_ps(0.5f), threeHalfs = _mm256_set1_ps(1.5f);
+	__m256 ax = _mm256_setzero_ps();
+	__m256 ay = _mm256_setzero_ps();
+	__m256 az = _mm256_setzero_ps();
+
+	unsigned j = 0;
+	for (; j + 8 <= count; j += 8) {
+		const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + j), vpx);
+		const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + j), vpy);
+		const __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + j), vpz);
+		const __m256 m = _mm256_loadu_ps(mass + j);
+		const __m256 l2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(
+			dy, dy, _mm256_mul_ps(dz, dz)));
+		const __m256 s = law == force::PLUMMER ? _mm256_add_ps(l2, soft)
+			: law == force::CUTOFF ? _mm256_max_ps(l2, soft) : l2;
+
+		__m256 inv3;
+		if (rsqrt) {
+			__m256 r = _mm256_rsqrt_ps(s);
+			const __m256 h = _mm256_mul_ps(half, s);
+			r = _mm256_mul_ps(r, _mm256_fnmadd_ps(h, _mm256_mul_ps(r, r), threeHalfs));
+			inv3 = _mm256_mul_ps(r, _mm256_mul_ps(r, r));
+		} else {
+			inv3 = _mm256_div_ps(_mm256_set1_ps(1),
+			                     _mm256_mul_ps(s, _mm256_sqrt_ps(s)));
+		}
+
+		const __m256 mask = _mm256_and_ps(
+			_mm256_cmp_ps(l2, soft,
+				law == force::NEWTON ? _CMP_GE_OQ : _CMP_TRUE_UQ),
+			_mm256_cmp_ps(m, min, _CMP_GE_OQ));
+		const __m256 f = _mm256_and_ps(mask, _mm256_mul_ps(m, inv3));
+		ax = _mm256_fmadd_ps(f, dx, ax);
+		ay = _mm256_fmadd_ps(f, dy, ay);
+		az = _mm256_fmadd_ps(f, dz, az);
+	}
+
+	accelerationScalar(gravity, x + j, y + j, z + j, mass + j, count - j,
+	                   px, py, pz, out);
+	out[0] += sum(ax);
+	out[1] += sum(ay);
+	out[2] += sum(az);
+}
+
+
+template<force::Law law>
+__attribute__((target("avx512f")))
+static void accelerationAVX512(const force::Force<float, law> &gravity,
+                               bool rsqrt,
+                               const float *x, const float *y,
+                               const float *z, const float *mass,
+                               unsigned count,
+                               float px, float py, float pz,
+                               float out[3]) {
+	const __m512 vpx = _mm512_set1_ps(px);
+	const __m512 vpy = _mm512_set1_ps(py);
+	const __m512 vpz = _mm512_set1_ps(pz);
+	const __m512 min = _mm512_set1_ps(force::minMass);
+	const __m512 soft = _mm512_set1_ps(gravity.soft2);
+	const __m512 half = _mm512_set1_ps(0.5f), threeHalfs = _mm512_set1_ps(1.5f);
+	__m512 ax = _mm512_setzero_ps();
+	__m512 ay = _mm512_setzero_ps();
+	__m512 az = _mm512_setzero_ps();
+
+	for (unsigned j = 0; j < count; j += 16) {
+		const __mmask16 tail = count - j >= 16
+			? 0xffff : (__mmask16)((1u << (count - j)) - 1);
+		const __m512 m = _mm512_maskz_loadu_ps(tail, mass + j);
+		const __m512 dx = _mm512_sub_ps(_mm512_maskz_loadu_ps(tail, x + j), vpx);
+		const __m512 dy = _mm512_sub_ps(_mm512_maskz_loadu_ps(tail, y + j), vpy);
+		const __m512 dz = _mm512_sub_ps(_mm512_maskz_loadu_ps(tail, z + j), vpz);
+		const __m512 l2 = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(
+			dy, dy, _mm512_mul_ps(dz, dz)));
+		const __m512 s = law == force::PLUMMER ? _mm512_add_ps(l2, soft)
+			: law == force::CUTOFF ? _mm512_max_ps(l2, soft) : l2;
+
+		const __mmask16 mask = tail &
+			_mm512_cmp_ps_mask(l2, soft,
+				law == force::NEWTON ? _CMP_GE_OQ : _CMP_TRUE_UQ) &
+			_mm512_cmp_ps_mask(m, min, _CMP_GE_OQ);
+
+		__m512 inv3;
+		if (rsqrt) {
+			__m512 r = _mm512_rsqrt14_ps(s);
+			const __m512 h = _mm512_mul_ps(half, s);
+			r = _mm512_mul_ps(r, _mm512_fnmadd_ps(h, _mm512_mul_ps(r, r), threeHalfs));
+			inv3 = _mm512_mul_ps(r, _mm512_mul_ps(r, r));
+		} else {
+			inv3 = _mm512_div_ps(_mm512_set1_ps(1),
+			                     _mm512_mul_ps(s, _mm512_sqrt_ps(s)));
+		}
+
+		const __m512 f = _mm512_maskz_mul_ps(mask, m, inv3);
+		ax = _mm512_fmadd_ps(f, dx, ax);
+		ay = _mm512_fmadd_ps(f, dy, ay);
+		az = _mm512_fmadd_ps(f, dz, az);
+	}
+
+	out[0] = _mm512_reduce_add_ps(ax);
+	out[1] = _mm512_reduce_add_ps(ay);
+	out[2] = _mm512_reduce_add_ps(az);
+}
+
+
+
+template<force::Law law>
+__attribute__((target("avx2,fma")))
+static void accelerationAVX2Mixed(const force::Force<float, law> &gravity,
+                                  bool rsqrt,
+                                  const double *x, const double *y,
+                                  const double *z, const double *mass,
+                                  unsigned count,
+                                  double px, double py, double pz,
+                                  double out[3]) {
+	const __m256d vpx = _mm256_set1_pd(px);
+	const __m256d vpy = _mm256_set1_pd(py);
+	const __m256d vpz = _mm256_set1_pd(pz);
+	const __m256 min = _mm256_set1_ps(force::minMass);
+	const __m256 soft = _mm256_set1_ps(gravity.soft2);
+	const __m256 half = _mm256_set1_ps(0.5f), threeHalfs = _mm256_set1_ps(1.5f);
+	__m256d ax = _mm256_setzero_pd();
+	__m256d ay = _mm256_setzero_pd();
+	__m256d az = _mm256_setzero_pd();
+
+	unsigned j = 0;
+	for (; j + 8 <= count; j += 8) {
+		/* Separations in double, two halves of eight sources. */
+		const __m256d dxl = _mm256_sub_pd(_mm256_loadu_pd(x + j), vpx);
+		const __m256d dxh = _mm256_sub_pd(_mm256_loadu_pd(x + j + 4), vpx);
+		const __m256d dyl = _mm256_sub_pd(_mm256_loadu_pd(y + j), vpy);
+		const __m256d dyh = _mm256_sub_pd(_mm256_loadu_pd(y + j + 4), vpy);
+		const __m256d dzl = _mm256_sub_pd(_mm256_loadu_pd(z + j), vpz);
+		const __m256d dzh = _mm256_sub_pd(_mm256_loadu_pd(z + j + 4), vpz);
+
+		const __m256 dx = _mm256_set_m128(_mm256_cvtpd_ps(dxh), _mm256_cvtpd_ps(dxl));
+		const __m256 dy = _mm256_set_m128(_mm256_cvtpd_ps(dyh), _mm256_cvtpd_ps(dyl));
+		const __m256 dz = _mm256_set_m128(_mm256_cvtpd_ps(dzh), _mm256_cvtpd_ps(dzl));
+		const __m256 m = _mm256_set_m128(_mm256_cvtpd_ps(_mm256_loadu_pd(mass + j + 4)),
+		                                 _mm256_cvtpd_ps(_mm256_loadu_pd(mass + j)));
+		const __m256 l2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(
+			dy, dy, _mm256_mul_ps(dz, dz)));
+		const __m256 s = law == force::PLUMMER ? _mm256_add_ps(l2, soft)
+			: law == force::CUTOFF ? _mm256_max_ps(l2, soft) : l2;
+
+		__m256 inv3;
+		if (rsqrt) {
+			__m256 r = _mm256_rsqrt_ps(s);
+			const __m256 h = _mm256_mul_ps(half, s);
+			r = _mm256_mul_ps(r, _mm256_fnmadd_ps(h, _mm256_mul_ps(r, r), threeHalfs));
+			inv3 = _mm256_mul_ps(r, _mm256_mul_ps(r, r));
+		} else {
+			inv3 = _mm256_div_ps(_mm256_set1_ps(1),
+			                     _mm256_mul_ps(s, _mm256_sqrt_ps(s)));
+		}
+
+		const __m256 mask = _mm256_and_ps(
+			_mm256_cmp_ps(l2, soft,
+				law == force::NEWTON ? _CMP_GE_OQ : _CMP_TRUE_UQ),
+			_mm256_cmp_ps(m, min, _CMP_GE_OQ));
+		const __m256 f = _mm256_and_ps(mask, _mm256_mul_ps(m, inv3));
+
+		/* Back to double for accumulation. */
+		const __m256d fl = _mm256_cvtps_pd(_mm256_castps256_ps128(f));
+		const __m256d fh = _mm256_cvtps_pd(_mm256_extractf128_ps(f, 1));
+		ax = _mm256_fmadd_pd(fh, dxh, _mm256_fmadd_pd(fl, dxl, ax));
+		ay = _mm256_fmadd_pd(fh, dyh, _mm256_fmadd_pd(fl, dyl, ay));
+		az = _mm256_fmadd_pd(fh, dzh, _mm256_fmadd_pd(fl, dzl, az));
+	}
+
+	accelerationScalarMixed(gravity, x + j, y + j, z + j, mass + j,
+	                        count - j, px, py, pz, out);
+	out[0] += sum(ax);
+	out[1] += sum(ay);
+	out[2] += sum(az);
+}
+
+
+__attribute__((target("avx512f")))
+static inline __m512 join(__m256 lo, __m256 hi) {
+	return _mm512_castpd_ps(_mm512_insertf64x4(
+		_mm512_castps_pd(_mm512_castps256_ps512(lo)),
+		_mm256_castps_pd(hi), 1));
+}
+
+template<force::Law law>
+__attribute__((target("avx512f")))
+static void accelerationAVX512Mixed(const force::Force<float, law> &gravity,
+                                    bool rsqrt,
+                                    const double *x, const double *y,
+                                    const double *z, const double *mass,
+                                    unsigned count,
+                                    double px, double py, double pz,
+                                    double out[3]) {
+	const __m512d vpx = _mm512_set1_pd(px);
+	const __m512d vpy = _mm512_set1_pd(py);
+	const __m512d vpz = _mm512_set1_pd(pz);
+	const __m512 min = _mm512_set1_ps(force::minMass);
+	const __m512 soft = _mm512_set1_ps(gravity.soft2);
+	const __m512 half = _mm512_set1_ps(0.5f), threeHalfs = _mm512_set1_ps(1.5f);
+	__m512d ax = _mm512_setzero_pd();
+	__m512d ay = _mm512_setzero_pd();
+	__m512d az = _mm512_setzero_pd();
+
+	for (unsigned j = 0; j < count; j += 16) {
+		const unsigned left = count - j;
+		const __mmask8 tl = left >= 8 ? 0xff : (__mmask8)((1u << left) - 1);
+		const __mmask8 th = left >= 16 ? 0xff
+			: left <= 8 ? 0 : (__mmask8)((1u << (left - 8)) - 1);
+
+		/* Separations in double, two halves of sixteen sources. */
+		const __m512d dxl = _mm512_sub_pd(_mm512_maskz_loadu_pd(tl, x + j), vpx);
+		const __m512d dxh = _mm512_sub_pd(_mm512_maskz_loadu_pd(th, x + j + 8), vpx);
+		const __m512d dyl = _mm512_sub_pd(_mm512_maskz_loadu_pd(tl, y + j), vpy);
+		const __m512d dyh = _mm512_sub_pd(_mm512_maskz_loadu_pd(th, y + j + 8), vpy);
+		const __m512d dzl = _mm512_sub_pd(_mm512_maskz_loadu_pd(tl, z + j), vpz);
+		const __m512d dzh = _mm512_sub_pd(_mm512_maskz_loadu_pd(th, z + j + 8), vpz);
+
+		const __m512 dx = join(_mm512_cvtpd_ps(dxl), _mm512_cvtpd_ps(dxh));
+		const __m512 dy = join(_mm512_cvtpd_ps(dyl), _mm512_cvtpd_ps(dyh));
+		const __m512 dz = join(_mm512_cvtpd_ps(dzl), _mm512_cvtpd_ps(dzh));
+		const __m512 m = join(
+			_mm512_cvtpd_ps(_mm512_maskz_loadu_pd(tl, mass + j)),
+			_mm512_cvtpd_ps(_mm512_maskz_loadu_pd(th, mass + j + 8)));
+		const __m512 l2 = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(
+			dy, dy, _mm512_mul_ps(dz, dz)));
+		const __m512 s = law == force::PLUMMER ? _mm512_add_ps(l2, soft)
+			: law == force::CUTOFF ? _mm512_max_ps(l2, soft) : l2;
+
+		const __mmask16 mask = (tl | (__mmask16)th << 8) &
+			_mm512_cmp_ps_mask(l2, soft,
+				law == force::NEWTON ? _CMP_GE_OQ : _CMP_TRUE_UQ) &
+			_mm512_cmp_ps_mask(m, min, _CMP_GE_OQ);
+
+		__m512 inv3;
+		if (rsqrt) {
+			__m512 r = _mm512_rsqrt14_ps(s);
+			const __m512 h = _mm512_mul_ps(half, s);
+			r = _mm512_mul_ps(r, _mm512_fnmadd_ps(h, _mm512_mul_ps(r, r), threeHalfs));
+			inv3 = _mm512_mul_ps(r, _mm512_mul_ps(r, r));
+		} else {
+			inv3 = _mm512_div_ps(_mm512_set1_ps(1),
+			                     _mm512_mul_ps(s, _mm512_sqrt_ps(s)));
+		}
+
+		/* Back to double for accumulation. */
+		const __m512 f = _mm512_maskz_mul_ps(mask, m, inv3);
+		const __m512d fl = _mm512_cvtps_pd(_mm512_castps512_ps256(f));
+		const __m512d fh = _mm512_cvtps_pd(_mm256_castpd_ps(
+			_mm512_extractf64x4_pd(_mm512_castps_pd(f), 1)));
+		ax = _mm512_fmadd_pd(fh, dxh, _mm512_fmadd_pd(fl, dxl, ax));
+		ay = _mm512_fmadd_pd(fh, dyh, _mm512_fmadd_pd(fl, dyl, ay));
+		az = _mm512_fmadd_pd(fh, dzh, _mm512_fmadd_pd(fl, dzl, az));
+	}
+
+	out[0] = _mm512_reduce_add_pd(ax);
+	out[1] = _mm512_reduce_add_pd(ay);
+	out[2] = _mm512_reduce_add_pd(az);
+}
+
+
+/*
+ * Kernels below are vectorised over points rather than over sources:
+ * each source is broadcast to all lanes and its force on a vector of
+ * points is calculated at once.  Sources lighter then force::minMass
+ * are skipped before that so masses need not be masked.
+ */
+
+template<force::Law law>
+__attribute__((target("avx2,fma")))
+static void accelerationsAVX2(const force::Force<double, law> &gravity,
+                              bool rsqrt, const double *x, const double *y,
+                              const double *z, const double *mass,
+                              unsigned count,
+                              const double *px, const double *py,
+                              const double *pz, unsigned points,
+                              double *ax, double *ay, double *az) {
+	const __m256d soft = _mm256_set1_pd(gravity.soft2);
+	const __m256d half = _mm256_set1_pd(0.5), threeHalfs = _mm256_set1_pd(1.5);
+
+	unsigned i = 0;
+	for (; i + 4 <= points; i += 4) {
+		const __m256d vpx = _mm256_loadu_pd(px + i);
+		const __m256d vpy = _mm256_loadu_pd(py + i);
+		const __m256d vpz = _mm256_loadu_pd(pz + i);
+		__m256d sx = _mm256_setzero_pd();
+		__m256d sy = _mm256_setzero_pd();
+		__m256d sz = _mm256_setzero_pd();
+
+		for (unsigned j = 0; j < count; ++j) {
+			if (mass[j] < force::minMass) continue;
+			const __m256d dx = _mm256_sub_pd(_mm256_set1_pd(x[j]), vpx);
+			const __m256d dy = _mm256_sub_pd(_mm256_set1_pd(y[j]), vpy);
+			const __m256d dz = _mm256_sub_pd(_mm256_set1_pd(z[j]), vpz);
+			const __m256d l2 = _mm256_fmadd_pd(dx, dx, _mm256_fmadd_pd(
+				dy, dy, _mm256_mul_pd(dz, dz)));
+			const __m256d s = law == force::PLUMMER ? _mm256_add_pd(l2, soft)
+				: law == force::CUTOFF ? _mm256_max_pd(l2, soft) : l2;
+
+			__m256d inv3;
+			if (rsqrt) {
+				__m256d r = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(s)));
+				const __m256d h = _mm256_mul_pd(half, s);
+				r = _mm256_mul_pd(r, _mm256_fnmadd_pd(h, _mm256_mul_pd(r, r), threeHalfs));
+				r = _mm256_mul_pd(r, _mm256_fnmadd_pd(h, _mm256_mul_pd(r, r), threeHalfs));
+				inv3 = _mm256_mul_pd(r, _mm256_mul_pd(r, r));
+			} else {
+				inv3 = _mm256_div_pd(_mm256_set1_pd(1),
+				                     _mm256_mul_pd(s, _mm256_sqrt_pd(s)));
+			}
+
+			const __m256d f = _mm256_and_pd(
+				_mm256_cmp_pd(l2, soft,
+					law == force::NEWTON ? _CMP_GE_OQ : _CMP_TRUE_UQ),
+				_mm256_mul_pd(_mm256_set1_pd(mass[j]), inv3));
+			sx = _mm256_fmadd_pd(f, dx, sx);
+			sy = _mm256_fmadd_pd(f, dy, sy);
+			sz = _mm256_fmadd_pd(f, dz, sz);
+		}
+
+		_mm256_storeu_pd(ax + i, sx);
+		_mm256_storeu_pd(ay + i, sy);
+		_mm256_storeu_pd(az + i, sz);
+	}
+
+	accelerationsScalar(gravity, x, y, z, mass, count,
+	                    px + i, py + i, pz + i, points - i,
+	                    ax + i, ay + i, az + i);
+}
+
+
+template<force::Law law>
+__attribute__((target("avx512f")))
+static void accelerationsAVX512(const force::Force<double, law> &gravity,
+                                bool rsqrt, const double *x, const double *y,
+                                const double *z, const double *mass,
+                                unsigned count,
+                                const double *px, const double *py,
+                                const double *pz, unsigned points,
+                                double *ax, double *ay, double *az) {
+	const __m512d soft = _mm512_set1_pd(gravity.soft2);
+	const __m512d half = _mm512_set1_pd(0.5), threeHalfs = _mm512_set1_pd(1.5);
+
+	for (unsigned i = 0; i < points; i += 8) {
+		const __mmask8 tail = points - i >= 8
+			? 0xff : (__mmask8)((1u << (points - i)) - 1);
+		const __m512d vpx = _mm512_maskz_loadu_pd(tail, px + i);
+		const __m512d vpy = _mm512_maskz_loadu_pd(tail, py + i);
+		const __m512d vpz = _mm512_maskz_loadu_pd(tail, pz + i);
+		__m512d sx = _mm512_setzero_pd();
+		__m512d sy = _mm512_setzero_pd();
+		__m512d sz = _mm512_setzero_pd();
+
+		for (unsigned j = 0; j < count; ++j) {
+			if (mass[j] < force::minMass) continue;
+			const __m512d dx = _mm512_sub_pd(_mm512_set1_pd(x[j]), vpx);
+			const __m512d dy = _mm512_sub_pd(_mm512_set1_pd(y[j]), vpy);
+			const __m512d dz = _mm512_sub_pd(_mm512_set1_pd(z[j]), vpz);
+			const __m512d l2 = _mm512_fmadd_pd(dx, dx, _mm512_fmadd_pd(
+				dy, dy, _mm512_mul_pd(dz, dz)));
+			const __m512d s = law == force::PLUMMER ? _mm512_add_pd(l2, soft)
+				: law == force::CUTOFF ? _mm512_max_pd(l2, soft) : l2;
+
+			__m512d inv3;
+			if (rsqrt) {
+				__m512d r = _mm512_rsqrt14_pd(s);
+				const __m512d h = _mm512_mul_pd(half, s);
+				r = _mm512_mul_pd(r, _mm512_fnmadd_pd(h, _mm512_mul_pd(r, r), threeHalfs));
+				r = _mm512_mul_pd(r, _mm512_fnmadd_pd(h, _mm512_mul_pd(r, r), threeHalfs));
+				inv3 = _mm512_mul_pd(r, _mm512_mul_pd(r, r));
+			} else {
+				inv3 = _mm512_div_pd(_mm512_set1_pd(1),
+				                     _mm512_mul_pd(s, _mm512_sqrt_pd(s)));
+			}
+
+			const __mmask8 mask = _mm512_cmp_pd_mask(l2, soft,
+				law == force::NEWTON ? _CMP_GE_OQ : _CMP_TRUE_UQ);
+			const __m512d f = _mm512_maskz_mul_pd(mask,
+				_mm512_set1_pd(mass[j]), inv3);
+			sx = _mm512_fmadd_pd(f, dx, sx);
+			sy = _mm512_fmadd_pd(f, dy, sy);
+			sz = _mm512_fmadd_pd(f, dz, sz);
+		}
+
+		_mm512_mask_storeu_pd(ax + i, tail, sx);
+		_mm512_mask_storeu_pd(ay + i, tail, sy);
+		_mm512_mask_storeu_pd(az + i, tail, sz);
+	}
+}
+
+
+template<force::Law law>
+__attribute__((target("avx2,fma")))
+static void accelerationsAVX2(const force::Force<float, law> &gravity,
+                              bool rsqrt, const float *x, const float *y,
+                              const float *z, const float *mass,
+                              unsigned count,
+                              const float *px, const float *py,
+                              const float *pz, unsigned points,
+                              float *ax, float *ay, float *az) {
+	const __m256 soft = _mm256_set1_ps(gravity.soft2);
+	const __m256 half = _mm256_set1_ps(0.5f), threeHalfs = _mm256_set1_ps(1.5f);
+
+	unsigned i = 0;
+	for (; i + 8 <= points; i += 8) {
+		const __m256 vpx = _mm256_loadu_ps(px + i);
+		const __m256 vpy = _mm256_loadu_ps(py + i);
+		const __m256 vpz = _mm256_loadu_ps(pz + i);
+		__m256 sx = _mm256_setzero_ps();
+		__m256 sy = _mm256_setzero_ps();
+		__m256 sz = _mm256_setzero_ps();
+
+		for (unsigned j = 0; j < count; ++j) {
+			if (mass[j] < force::minMass) continue;
+			const __m256 dx = _mm256_sub_ps(_mm256_set1_ps(x[j]), vpx);
+			const __m256 dy = _mm256_sub_ps(_mm256_set1_ps(y[j]), vpy);
+			const __m256 dz = _mm256_sub_ps(_mm256_set1_ps(z[j]), vpz);
+			const __m256 l2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(
+				dy, dy, _mm256_mul_ps(dz, dz)));
+			const __m256 s = law == force::PLUMMER ? _mm256_add_ps(l2, soft)
+				: law == force::CUTOFF ? _mm256_max_ps(l2, soft) : l2;
+
+			__m256 inv3;
+			if (rsqrt) {
+				__m256 r = _mm256_rsqrt_ps(s);
+				const __m256 h = _mm256_mul_ps(half, s);
+				r = _mm256_mul_ps(r, _mm256_fnmadd_ps(h, _mm256_mul_ps(r, r), threeHalfs));
+				inv3 = _mm256_mul_ps(r, _mm256_mul_ps(r, r));
+			} else {
+				inv3 = _mm256_div_ps(_mm256_set1_ps(1),
+				                     _mm256_mul_ps(s, _mm256_sqrt_ps(s)));
+			}
+
+			const __m256 f = _mm256_and_ps(
+				_mm256_cmp_ps(l2, soft,
+					law == force::NEWTON ? _CMP_GE_OQ : _CMP_TRUE_UQ),
+				_mm256_mul_ps(_mm256_set1_ps(mass[j]), inv3));
+			sx = _mm256_fmadd_ps(f, dx, sx);
+			sy = _mm256_fmadd_ps(f, dy, sy);
+			sz = _mm256_fmadd_ps(f, dz, sz);
+		}
+
+		_mm256_storeu_ps(ax + i, sx);
+		_mm256_storeu_ps(ay + i, sy);
+		_mm256_storeu_ps(az + i, sz);
+	}
+
+	accelerationsScalar(gravity, x, y, z, mass, count,
+	                    px + i, py + i, pz + i, points - i,
+	                    ax + i, ay + i, az + i);
+}
+
+
+template<force::Law law>
+__attribute__((target("avx512f")))
+static void accelerationsAVX512(const force::Force<float, law> &gravity,
+                                bool rsqrt, const float *x, const float *y,
+                                const float *z, const float *mass,
+                                unsigned count,
+                                const float *px, const float *py,
+                                const float *pz, unsigned points,
+                                float *ax, float *ay, float *az) {
+	const __m512 soft = _mm512_set1_ps(gravity.soft2);
+	const __m512 half = _mm512_set1_ps(0.5f), threeHalfs = _mm512_set1_ps(1.5f);
+
+	for (unsigned i = 0; i < points; i += 16) {
+		const __mmask16 tail = points - i >= 16
+			? 0xffff : (__mmask16)((1u << (points - i)) - 1);
+		const __m512 vpx = _mm512_maskz_loadu_ps(tail, px + i);
+		const __m512 vpy = _mm512_maskz_loadu_ps(tail, py + i);
+		const __m512 vpz = _mm512_maskz_loadu_ps(tail, pz + i);
+		__m512 sx = _mm512_setzero_ps();
+		__m512 sy = _mm512_setzero_ps();
+		__m512 sz = _mm512_setzero_ps();
+
+		for (unsigned j = 0; j < count; ++j) {
+			if (mass[j] < force::minMass) continue;
+			const __m512 dx = _mm512_sub_ps(_mm512_set1_ps(x[j]), vpx);
+			const __m512 dy = _mm512_sub_ps(_mm512_set1_ps(y[j]), vpy);
+			const __m512 dz = _mm512_sub_ps(_mm512_set1_ps(z[j]), vpz);
+			const __m512 l2 = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(
+				dy, dy, _mm512_mul_ps(dz, dz)));
+			const __m512 s = law == force::PLUMMER ? _mm512_add_ps(l2, soft)
+				: law == force::CUTOFF ? _mm512_max_ps(l2, soft) : l2;
+
+			__m512 inv3;
+			if (rsqrt) {
+				__m512 r = _mm512_rsqrt14_ps(s);
+				const __m512 h = _mm512_mul_ps(half, s);
+				r = _mm512_mul_ps(r, _mm512_fnmadd_ps(h, _mm512_mul_ps(r, r), threeHalfs));
+				inv3 = _mm512_mul_ps(r, _mm512_mul_ps(r, r));
+			} else {
+				inv3 = _mm512_div_ps(_mm512_set1_ps(1),
+				                     _mm512_mul_ps(s, _mm512_sqrt_ps(s)));
+			}
+
+			const __mmask16 mask = _mm512_cmp_ps_mask(l2, soft,
+				law == force::NEWTON ? _CMP_GE_OQ : _CMP_TRUE_UQ);
+			const __m512 f = _mm512_maskz_mul_ps(mask,
+				_mm512_set1_ps(mass[j]), inv3);
+			sx = _mm512_fmadd_ps(f, dx, sx);
+			sy = _mm512_fmadd_ps(f, dy, sy);
+			sz = _mm512_fmadd_ps(f, dz, sz);
+		}
+
+		_mm512_mask_storeu_ps(ax + i, tail, sx);
+		_mm512_mask_storeu_ps(ay + i, tail, sy);
+		_mm512_mask_storeu_ps(az + i, tail, sz);
+	}
+}
+
+#endif
+
+
+void acceleration(Isa isa, bool rsqrt, force::Law law, double softening,
+                  const double *x, const double *y, const double *z,
+                  const double *mass, unsigned count,
+                  double px, double py, double pz, double out[3]) {
+	force::dispatch<double>(law, softening, [=](const auto &gravity) {
+		switch (isa) {
+#ifdef MN_KERNEL_X86
+		case AVX2:
+			accelerationAVX2(gravity, rsqrt, x, y, z, mass, count,
+			                 px, py, pz, out);
+			break;
+		case AVX512:
+			accelerationAVX512(gravity, rsqrt, x, y, z, mass, count,
+			                   px, py, pz, out);
+			break;
+#endif
+		default:
+			(void)rsqrt;
+			accelerationScalar(gravity, x, y, z, mass, count,
+			                   px, py, pz, out);
+		}
+	});
+}
+
+void acceleration(Isa isa, bool rsqrt, force::Law law, double softening,
+                  const float *x, const float *y, const float *z,
+                  const float *mass, unsigned count,
+                  float px, float py, float pz, float out[3]) {
+	force::dispatch<float>(law, softening, [=](const auto &gravity) {
+		switch (isa) {
+#ifdef MN_KERNEL_X86
+		case AVX2:
+			accelerationAVX2(gravity, rsqrt, x, y, z, mass, count,
+			                 px, py, pz, out);
+			break;
+		case AVX512:
+			accelerationAVX512(gravity, rsqrt, x, y, z, mass, count,
+			                   px, py, pz, out);
+			break;
+#endif
+		default:
+			(void)rsqrt;
+			accelerationScalar(gravity, x, y, z, mass, count,
+			                   px, py, pz, out);
+		}
+	});
+}
+
+void accelerationMixed(Isa isa, bool rsqrt, force::Law law, double softening,
+                       const double *x, const double *y, const double *z,
+                       const double *mass, unsigned count,
+                       double px, double py, double pz, double out[3]) {
+	force::dispatch<float>(law, softening, [=](const auto &gravity) {
+		switch (isa) {
+#ifdef MN_KERNEL_X86
+		case AVX2:
+			accelerationAVX2Mixed(gravity, rsqrt, x, y, z, mass, count,
+			                      px, py, pz, out);
+			break;
+		case AVX512:
+			accelerationAVX512Mixed(gravity, rsqrt, x, y, z, mass, count,
+			                        px, py, pz, out);
+			break;
+#endif
+		default:
+			(void)rsqrt;
+			accelerationScalarMixed(gravity, x, y, z, mass, count,
+			                        px, py, pz, out);
+		}
+	});
+}
+
+void acceleration(Isa isa, bool rsqrt, force::Law law, double softening,
+                  const long double *x, const long double *y,
+                  const long double *z, const long double *mass,
+                  unsigned count, long double px, long double py,
+                  long double pz, long double out[3]) {
+	(void)isa;
+	(void)rsqrt;
+	force::dispatch<long double>(law, softening, [=](const auto &gravity) {
+		accelerationScalar(gravity, x, y, z, mass, count, px, py, pz, out);
+	});
+}
+
+
+void accelerations(Isa isa, bool rsqrt, force::Law law, double softening,
+                   const double *x, const double *y, const double *z,
+                   const double *mass, unsigned count,
+                   const double *px, const double *py, const double *pz,
+                   unsigned points, double *ax, double *ay, double *az) {
+	force::dispatch<double>(law, softening, [=](const auto &gravity) {
+		switch (isa) {
+#ifdef MN_KERNEL_X86
+		case AVX2:
+			accelerationsAVX2(gravity, rsqrt, x, y, z, mass, count,
+			                  px, py, pz, points, ax, ay, az);
+			break;
+		case AVX512:
+			accelerationsAVX512(gravity, rsqrt, x, y, z, mass, count,
+			                    px, py, pz, points, ax, ay, az);
+			break;
+#endif
+		default:
+			(void)rsqrt;
+			accelerationsScalar(gravity, x, y, z, mass, count,
+			                    px, py, pz, points, ax, ay, az);
+		}
+	});
+}
+
+void accelerations(Isa isa, bool rsqrt, force::Law law, double softening,
+                   const float *x, const float *y, const float *z,
+                   const float *mass, unsigned count,
+                   const float *px, const float *py, const float *pz,
+                   unsigned points, float *ax, float *ay, float *az) {
+	force::dispatch<float>(law, softening, [=](const auto &gravity) {
+		switch (isa) {
+#ifdef MN_KERNEL_X86
+		case AVX2:
+			accelerationsAVX2(gravity, rsqrt, x, y, z, mass, count,
+			                  px, py, pz, points, ax, ay, az);
+			break;
+		case AVX512:
+			accelerationsAVX512(gravity, rsqrt, x, y, z, mass, count,
+			                    px, py, pz, points, ax, ay, az);
+			break;
+#endif
+		default:
+			(void)rsqrt;
+			accelerationsScalar(gravity, x, y, z, mass, count,
+			                    px, py, pz, points, ax, ay, az);
+		}
+	});
+}
+
+void accelerations(Isa isa, bool rsqrt, force::Law law, double softening,
+                   const long double *x, const long double *y,
+                   const long double *z, const long double *mass,
+                   unsigned count, const long double *px,
+                   const long double *py, const long double *pz,
+                   unsigned points,
+                   long double *ax, long double *ay, long double *az) {
+	(void)isa;
+	(void)rsqrt;
+	force::dispatch<long double>(law, softening, [=](const auto &gravity) {
+		accelerationsScalar(gravity, x, y, z, mass, count,
+		                    px, py, pz, points, ax, ay, az);
+	});
+}
+
+}
+
+}
+
+}
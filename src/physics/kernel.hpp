@@ -0,0 +1,183 @@
+/*
+ * src/physics/kernel.hpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef H_KERNEL_HPP
+#define H_KERNEL_HPP
+
+#include "force.hpp"
+
+
+namespace mn {
+
+namespace physics {
+
+
+/**
+ * Vectorised gravity kernels.  Each kernel sums accelerations caused
+ * in a given point by a set of sources given as separate arrays of
+ * coordinates and masses.  Just like the direct sum, sources lighter
+ * then force::minMass are skipped and force law is applied (see
+ * force::Force); the law is a template argument of the inner loops.
+ * Result is not multiplied by the gravitational constant.
+ */
+namespace kernel {
+
+
+/** Instruction sets kernel can be implemented with. */
+enum Isa {
+	/** Plain C++ loop, works everywhere. */
+	SCALAR,
+	/** 4 sources at once (8 in single precision). */
+	AVX2,
+	/** 8 sources at once (16 in single precision). */
+	AVX512
+};
+
+/** Returns the best instruction set supported by the CPU. */
+Isa detect();
+
+/** Returns whether CPU supports given instruction set. */
+bool supported(Isa isa);
+
+/** Returns user readable name of instruction set. */
+const char *name(Isa isa);
+
+/**
+ * Parses instruction set's name.
+ * \param str either "scalar", "avx2", "avx512" or "auto"; the latter
+ *        means the best supported instruction set.
+ * \param isa location to save result to.
+ * \return whether name was recognised and is supported by the CPU.
+ */
+bool parse(const char *str, Isa &isa);
+
+
+/**
+ * Sums accelerations caused in point (px, py, pz).
+ *
+ * \param isa instruction set to use; must be supported.
+ * \param rsqrt whether to use approximate reciprocal square root
+ *        refined with Newton-Raphson iterations instead of a square
+ *        root followed by a division; ignored by scalar kernel.
+ * \param law force law.
+ * \param softening softening length of the law.
+ * \param x x coordinates of sources.
+ * \param y y coordinates of sources.
+ * \param z z coordinates of sources.
+ * \param mass masses of sources.
+ * \param count number of sources.
+ * \param px point's x coordinate.
+ * \param py point's y coordinate.
+ * \param pz point's z coordinate.
+ * \param out array to save acceleration's coordinates to.
+ */
+void acceleration(Isa isa, bool rsqrt, force::Law law, double softening,
+                  const double *x, const double *y, const double *z,
+                  const double *mass, unsigned count,
+                  double px, double py, double pz, double out[3]);
+
+/**
+ * Single precision variant of the kernel.  With rsqrt the estimate
+ * is refined once which gives nearly full single precision.
+ */
+void acceleration(Isa isa, bool rsqrt, force::Law law, double softening,
+                  const float *x, const float *y, const float *z,
+                  const float *mass, unsigned count,
+                  float px, float py, float pz, float out[3]);
+
+/**
+ * Mixed precision variant of the kernel.  Separations are calculated
+ * and accelerations accumulated in double precision but squared
+ * distances, inverse distances and force magnitudes are calculated
+ * in single precision lanes, so the expensive part runs at single
+ * precision width while result is not affected by distance of
+ * objects from the origin.
+ */
+void accelerationMixed(Isa isa, bool rsqrt, force::Law law, double softening,
+                       const double *x, const double *y, const double *z,
+                       const double *mass, unsigned count,
+                       double px, double py, double pz, double out[3]);
+
+/**
+ * Extended precision variant of the kernel.  There are no vector
+ * instructions for long double so \a isa and \a rsqrt are ignored.
+ */
+void acceleration(Isa isa, bool rsqrt, force::Law law, double softening,
+                  const long double *x, const long double *y,
+                  const long double *z, const long double *mass,
+                  unsigned count, long double px, long double py,
+                  long double pz, long double out[3]);
+
+
+/**
+ * Sums accelerations caused in many points at once.  Unlike
+ * acceleration(), vector lanes hold different points rather than
+ * different sources, so this is the kernel of choice when there are
+ * many more points then sources, e.g. tracers (see
+ * BasicObjects::addTracer()).
+ *
+ * \param isa instruction set to use; must be supported.
+ * \param rsqrt whether to use approximate reciprocal square root; see
+ *        acceleration().
+ * \param law force law.
+ * \param softening softening length of the law.
+ * \param x x coordinates of sources.
+ * \param y y coordinates of sources.
+ * \param z z coordinates of sources.
+ * \param mass masses of sources.
+ * \param count number of sources.
+ * \param px x coordinates of points.
+ * \param py y coordinates of points.
+ * \param pz z coordinates of points.
+ * \param points number of points.
+ * \param ax array to save x coordinates of accelerations to.
+ * \param ay array to save y coordinates of accelerations to.
+ * \param az array to save z coordinates of accelerations to.
+ */
+void accelerations(Isa isa, bool rsqrt, force::Law law, double softening,
+                   const double *x, const double *y, const double *z,
+                   const double *mass, unsigned count,
+                   const double *px, const double *py, const double *pz,
+                   unsigned points, double *ax, double *ay, double *az);
+
+/** Single precision variant of the above. */
+void accelerations(Isa isa, bool rsqrt, force::Law law, double softening,
+                   const float *x, const float *y, const float *z,
+                   const float *mass, unsigned count,
+                   const float *px, const float *py, const float *pz,
+                   unsigned points, float *ax, float *ay, float *az);
+
+/**
+ * Extended precision variant of the above; \a isa and \a rsqrt are
+ * ignored.
+ */
+void accelerations(Isa isa, bool rsqrt, force::Law law, double softening,
+                   const long double *x, const long double *y,
+                   const long double *z, const long double *mass,
+                   unsigned count, const long double *px,
+                   const long double *py, const long double *pz,
+                   unsigned points,
+                   long double *ax, long double *ay, long double *az);
+
+
+}
+
+}
+
+}
+
+#endif
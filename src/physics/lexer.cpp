@@ -64,10 +64,15 @@ struct Keyword {
 static const Keyword keywords[] = {
 	/* !!! KEEP THAT SORTED !!! */
 	{ "auto",     static_cast<unsigned short>(Lexer::T_AUTO)     },
+	{ "cloud",    static_cast<unsigned short>(Lexer::T_CLOUD)    },
 	{ "color",    static_cast<unsigned short>(Lexer::T_COLOR)    },
+	{ "cutoff",   static_cast<unsigned short>(Lexer::T_CUTOFF)   },
+	{ "force",    static_cast<unsigned short>(Lexer::T_FORCE)    },
 	{ "frozen",   static_cast<unsigned short>(Lexer::T_FROZEN)   },
 	{ "light",    static_cast<unsigned short>(Lexer::T_LIGHT)    },
 	{ "mass",     static_cast<unsigned short>(Lexer::T_MASS)     },
+	{ "newton",   static_cast<unsigned short>(Lexer::T_NEWTON)   },
+	{ "plummer",  static_cast<unsigned short>(Lexer::T_PLUMMER)  },
 	{ "size",     static_cast<unsigned short>(Lexer::T_SIZE)     },
 	{ "texture",  static_cast<unsigned short>(Lexer::T_TEXTURE)  },
 	{ "vel",      static_cast<unsigned short>(Lexer::T_VELOCITY) },
@@ -131,7 +136,7 @@ int Lexer::nextToken(Value &value, Location &location) {
 		return ch;
 	}
 
-	float mul = 1.0;
+	double mul = 1.0;
 	std::string str;
 	if (ch == '-') {
 		ch = getchar();
@@ -185,7 +190,7 @@ int Lexer::nextToken(Value &value, Location &location) {
 	/* Return number */
 	ungetchar(ch);
 	location.end = current;
-	value.real = mul * std::strtof(str.c_str(), 0);
+	value.real = mul * std::strtod(str.c_str(), 0);
 	return T_REAL;
 }
 
@@ -209,6 +214,11 @@ const char *Lexer::tokenName(int token) {
 	case T_COLOR:    return "\"color\"";
 	case T_AUTO:     return "\"auto\"";
 	case T_FROZEN:   return "\"frozen\"";
+	case T_FORCE:    return "\"force\"";
+	case T_NEWTON:   return "\"newton\"";
+	case T_PLUMMER:  return "\"plummer\"";
+	case T_CUTOFF:   return "\"cutoff\"";
+	case T_CLOUD:    return "\"cloud\"";
 
 	case T_REAL:     return "number";
 	case T_STRING:   return "string";
@@ -55,7 +55,8 @@ struct Lexer {
 	enum NamedTokens {
 		T_ERROR = -2, T_EOF = -1, /* errors and such */
 		T_VELOCITY = 256, T_SIZE, T_MASS, T_LIGHT, T_TEXTURE,
-		T_COLOR, T_AUTO, T_FROZEN, /* keywords */
+		T_COLOR, T_AUTO, T_FROZEN, T_FORCE, T_NEWTON, T_PLUMMER,
+		T_CUTOFF, T_CLOUD, /* keywords */
 		T_REAL, T_STRING /* tokens with parameters */
 	};
 
@@ -64,7 +65,7 @@ struct Lexer {
 
 
 	union Value {
-		float real;
+		double real;
 		char *string;
 	};
 
@@ -0,0 +1,119 @@
+/*
+ * src/physics/morton.cpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "object.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+
+namespace mn {
+
+namespace physics {
+
+
+/** Spreads lower 21 bits of v so that there are two zeros between
+ * each two of them. */
+static unsigned long long spread(unsigned long long v) {
+	v &= 0x1fffff;
+	v = (v | v << 32) & 0x1f00000000ffffull;
+	v = (v | v << 16) & 0x1f0000ff0000ffull;
+	v = (v | v <<  8) & 0x100f00f00f00f00full;
+	v = (v | v <<  4) & 0x10c30c30c30c30c3ull;
+	v = (v | v <<  2) & 0x1249249249249249ull;
+	return v;
+}
+
+
+/** Reorders elements so that k-th one is the one which was order[k]. */
+template<class V>
+static void permute(std::vector<V> &v, const std::vector<unsigned> &order) {
+	if (v.size() != order.size()) {
+		return;
+	}
+	std::vector<V> sorted;
+	sorted.reserve(v.size());
+	for (unsigned k = 0; k < order.size(); ++k) {
+		sorted.push_back(std::move(v[order[k]]));
+	}
+	v.swap(sorted);
+}
+
+
+template<class T>
+void BasicObjects<T>::sortAll() {
+	sinceSort = 0;
+	const unsigned n = size();
+	if (n < 2) {
+		return;
+	}
+
+	Vector min(x[0], y[0], z[0]), max = min;
+	for (unsigned i = 1; i < n; ++i) {
+		min.x = std::min(min.x, x[i]); max.x = std::max(max.x, x[i]);
+		min.y = std::min(min.y, y[i]); max.y = std::max(max.y, y[i]);
+		min.z = std::min(min.z, z[i]); max.z = std::max(max.z, z[i]);
+	}
+
+	/* Positions are quantised to 21 bits per axis in the bounding
+	 * cube so that the code fits in 64 bits. */
+	const Vector size = max - min;
+	const value_type extent = std::max(std::max(size.x, size.y), size.z);
+	const value_type scale = extent > 0 ? 0x1fffff / extent : 0;
+
+	std::vector<std::pair<unsigned long long, unsigned> > keys(n);
+	for (unsigned i = 0; i < n; ++i) {
+		keys[i].first =
+			spread((unsigned long long)((x[i] - min.x) * scale)) |
+			spread((unsigned long long)((y[i] - min.y) * scale)) << 1 |
+			spread((unsigned long long)((z[i] - min.z) * scale)) << 2;
+		keys[i].second = i;
+	}
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<unsigned> order(n);
+	for (unsigned k = 0; k < n; ++k) {
+		order[k] = keys[k].second;
+	}
+
+	permute(x, order); permute(y, order); permute(z, order);
+	permute(nextX, order); permute(nextY, order); permute(nextZ, order);
+	permute(vx, order); permute(vy, order); permute(vz, order);
+	permute(mass, order);
+	permute(sizes, order);
+	permute(frozen, order);
+	permute(objects, order);
+	permute(ids, order);
+
+	/* Accelerations and jerks carried over to the next tick follow
+	 * their objects (if they are not allocated yet nothing happens). */
+	permute(ax, order); permute(ay, order); permute(az, order);
+	permute(jx, order); permute(jy, order); permute(jz, order);
+	rearranged();
+}
+
+
+/* Rest of BasicObjects is instantiated in object.cpp. */
+template void BasicObjects<float>::sortAll();
+template void BasicObjects<double>::sortAll();
+template void BasicObjects<long double>::sortAll();
+
+
+}
+
+}
@@ -17,24 +17,15 @@
  */
 #include "object.hpp"
 
-#ifdef __APPLE__
-#  include <OpenGL/OpenGL.h>
-#  include <GLUT/glut.h>
-#else
-#  include <GL/glut.h>
-#endif
-
-#include <stdio.h>
-
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <vector>
 #include <queue>
 
-#include "../common/camera.hpp"
-#include "../common/text3d.hpp"
-#include "../common/sintable.hpp"
-#include "../common/quadric.hpp"
-#include "../common/mconst.h"
+#include "fmm.hpp"
+#include "octree.hpp"
+#include "thread-pool.hpp"
 
 
 namespace mn {
@@ -42,140 +33,681 @@ namespace mn {
 namespace physics {
 
 
-Object::Vector::value_type Object::cutoffDistance2 = 2500.0;
-bool Object::lowQuality = false;
-bool Object::drawNames = true;
-bool Object::useTextures = true;
-const Object::Vector::value_type Object::G = 6.67428-1;
+ObjectsBase::Integrator ObjectsBase::integrator = ObjectsBase::EULER;
+double ObjectsBase::eta = 0.02;
+ObjectsBase::Solver ObjectsBase::solver = ObjectsBase::DIRECT;
+double ObjectsBase::theta = 0.5;
+unsigned ObjectsBase::fmmOrder = 4;
+double ObjectsBase::refitTolerance = 0;
+ObjectsBase::Summation ObjectsBase::summation = ObjectsBase::NEUMAIER;
+bool ObjectsBase::useKernel = false;
+kernel::Isa ObjectsBase::isa = kernel::SCALAR;
+bool ObjectsBase::rsqrt = false;
+bool ObjectsBase::mixed = false;
+bool ObjectsBase::collisions = false;
+force::Law ObjectsBase::forceLaw = force::NEWTON;
+double ObjectsBase::softening = 0.1;
+unsigned ObjectsBase::fieldCells = 0;
+unsigned ObjectsBase::sortInterval = 0;
+bool ObjectsBase::deterministic = false;
+
+
+/* Number of partial sums of SYMMETRIC solver in deterministic mode. */
+static const unsigned deterministicSlots = 16;
+
+
+/**
+ * Sums \a count values lying \a stride elements apart by adding sums
+ * of both halves so that order of additions depends on count only.
+ */
+template<class T>
+static T treeSum(const T *values, unsigned count, unsigned stride) {
+	if (count < 2) {
+		return count ? *values : T(0);
+	}
+	const unsigned half = count / 2;
+	return treeSum(values, half, stride) +
+		treeSum(values + half * stride, count - half, stride);
+}
 
-static const GLfloat materialSpecular[] = { 0.75, 0.75, 0.75, 1 };
-static const GLfloat zeros           [] = { 0, 0, 0, 1 };
-static const GLfloat ones            [] = { 1, 1, 1, 1 };
+template<class T>
+const T BasicObjects<T>::G = 6.67428-1;
+
+template<class T>
+unsigned long long BasicObjects<T>::arrangements = 0;
+
+
+template<class T>
+unsigned BasicObjects<T>::add(const std::string &name) {
+	const unsigned i = size();
+	accelerationsValid = jerksValid = fieldValid = false;
+	rearranged();
+	x.push_back(0); y.push_back(0); z.push_back(0);
+	nextX.push_back(0); nextY.push_back(0); nextZ.push_back(0);
+	vx.push_back(0); vy.push_back(0); vz.push_back(0);
+	mass.push_back(1);
+	sizes.push_back(1);
+	frozen.push_back(false);
+	objects.push_back(Object(name));
+	ids.push_back(nextId++);
+	return i;
+}
+
+
+template<class T>
+unsigned BasicObjects<T>::find(const std::string &name) const {
+	for (unsigned i = 0; i < size(); ++i) {
+		if (objects[i].name == name) {
+			return i;
+		}
+	}
+	return none;
+}
 
 
 namespace {
-struct PushMatrix {
-	PushMatrix() { glPushMatrix(); }
-	~PushMatrix() { glPopMatrix(); }
-};
+	template<class T>
+	struct Acceleration {
+		gl::Vector<T> vector;
+		T value;
+
+		Acceleration(const gl::Vector<T> &theVector, const T &theValue)
+			: vector(theVector), value(theValue) { }
+		Acceleration(const gl::Vector<T> &theVector)
+			: vector(theVector), value(theVector.length()) { }
+
+		bool operator<(const Acceleration &a) const {
+			return value < a.value;
+		}
+	};
+}
+
+template<class T>
+typename BasicObjects<T>::Vector
+BasicObjects<T>::directAcceleration(unsigned i) const {
+	return directAcceleration(i, &mass[0]);
 }
 
+template<class T>
+typename BasicObjects<T>::Vector
+BasicObjects<T>::directAcceleration(unsigned i, const value_type *m) const {
+	static thread_local std::priority_queue<Acceleration<T> > accelerations;
+
+	force::dispatch<T>(forceLaw, softening, [=](const auto &gravity) {
+		const value_type px = x[i], py = y[i], pz = z[i];
+		for (unsigned j = 0, n = size(); j < n; ++j) {
+			if (j == i || m[j] < force::minMass) continue;
+			const Vector r(x[j] - px, y[j] - py, z[j] - pz);
+			const value_type l2 = r.length2();
+			if (gravity.skip(l2)) continue;
+			const value_type f = G * m[j] * gravity.factor(l2);
+			accelerations.push(Acceleration<T>(r * f, f * std::sqrt(l2)));
+		}
+	});
+
+	Vector a(0, 0, 0);
+	while (!accelerations.empty()) {
+		a += accelerations.top().vector;
+		accelerations.pop();
+	}
+	return a;
+}
+
+
+namespace {
+	/** Sums numbers keeping track of lost low order bits. */
+	template<class T>
+	struct NeumaierSum {
+		T sum, compensation;
+
+		NeumaierSum() : sum(0), compensation(0) { }
+
+		void operator+=(T value) {
+			const T t = sum + value;
+			if (std::fabs(sum) >= std::fabs(value)) {
+				compensation += (sum - t) + value;
+			} else {
+				compensation += (value - t) + sum;
+			}
+			sum = t;
+		}
 
-void Object::draw() {
-	const gl::Camera *const cam = gl::Camera::camera;
-	const bool inFront = cam ? cam->isInFront(point) : true;
+		T get() const { return sum + compensation; }
+	};
+}
 
-	PushMatrix _p;
+template<class T>
+typename BasicObjects<T>::Vector
+BasicObjects<T>::compensatedAcceleration(unsigned i) const {
+	NeumaierSum<T> ax, ay, az;
+	const value_type *const m = sources();
+
+	force::dispatch<T>(forceLaw, softening, [&](const auto &gravity) {
+		const value_type px = x[i], py = y[i], pz = z[i];
+		for (unsigned j = 0, n = size(); j < n; ++j) {
+			if (j == i || m[j] < force::minMass) continue;
+			const Vector r(x[j] - px, y[j] - py, z[j] - pz);
+			const value_type l2 = r.length2();
+			if (gravity.skip(l2)) continue;
+			const value_type f = G * m[j] * gravity.factor(l2);
+			ax += r.x * f;
+			ay += r.y * f;
+			az += r.z * f;
+		}
+	});
 
-	glTranslatef(point.x, point.y, point.z);
+	return Vector(ax.get(), ay.get(), az.get());
+}
 
-	if (light >= 0) {
-		glEnable(GL_LIGHT0 + light);
-		glLightfv(GL_LIGHT0 + light, GL_DIFFUSE, ones);
-		glLightfv(GL_LIGHT0 + light, GL_POSITION, zeros);
+template<class T>
+typename BasicObjects<T>::Vector
+BasicObjects<T>::pairwiseAcceleration(unsigned i, unsigned begin,
+                                      unsigned end) const {
+	/* Below this size rounding errors are negligible compared to the
+	 * cost of recursion. */
+	static const unsigned block = 16;
+
+	if (end - begin > block) {
+		const unsigned middle = begin + (end - begin) / 2;
+		return pairwiseAcceleration(i, begin, middle) +
+			pairwiseAcceleration(i, middle, end);
 	}
 
-	if (!inFront) {
-		return;
+	const value_type *const m = sources();
+	return force::dispatch<T>(forceLaw, softening,
+	                          [=](const auto &gravity) {
+		Vector a(0, 0, 0);
+		const value_type px = x[i], py = y[i], pz = z[i];
+		for (unsigned j = begin; j < end; ++j) {
+			if (j == i || m[j] < force::minMass) continue;
+			const Vector r(x[j] - px, y[j] - py, z[j] - pz);
+			const value_type l2 = r.length2();
+			if (gravity.skip(l2)) continue;
+			a += r * (G * m[j] * gravity.factor(l2));
+		}
+		return a;
+	});
+}
+
+
+template<class T>
+static Octree<T> &tree() {
+	static Octree<T> tree;
+	return tree;
+}
+
+template<class T>
+static Fmm<T> &fmm() {
+	static Fmm<T> fmm;
+	return fmm;
+}
+
+template<class T>
+void BasicObjects<T>::getTreeUpdates(unsigned long long &builds,
+                                     unsigned long long &refits) {
+	if (solver == FMM) {
+		builds = fmm<T>().getBuilds();
+		refits = fmm<T>().getRefits();
+	} else {
+		builds = tree<T>().getBuilds();
+		refits = tree<T>().getRefits();
 	}
+}
 
-	const bool gotTexture = useTextures && *texture;
-	if (gotTexture) {
-		glEnable(GL_TEXTURE_2D);
-		gluQuadricTexture(gl::Quadric::quadric()->get(), 1);
-		glBindTexture(GL_TEXTURE_2D, *texture);
-		glPushMatrix();
-		glRotatef(90.0f, 1.0f, 0.0f, 0.0f);
+template<class T>
+void BasicObjects<T>::prepareSolverAll() const {
+	if (empty()) {
+		return;
 	}
 
-	glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE,
-	             gotTexture ? ones : materialColor);
-	glMaterialfv(GL_FRONT, GL_SPECULAR,
-	             light >= 0 ? zeros : materialSpecular);
-	glMaterialfv(GL_FRONT, GL_EMISSION,
-	             light <  0 ? zeros : (gotTexture ? ones : materialColor));
-	glMaterialf(GL_FRONT, GL_SHININESS, light >= 0 ? 0 : 12);
+	/* Frozen objects are left out of the solver and their cached
+	 * field is added to accelerations instead. */
+	if (fieldCells) {
+		if (!fieldValid) {
+			field.build(&x[0], &y[0], &z[0], &mass[0], &frozen[0], size(),
+			            fieldCells, G, forceLaw, softening);
+			fieldValid = true;
+		}
 
-	const Vector::value_type distance2 = cam ? cam->getEye().distance2(point) : 0;
-	const Vector::value_type distanceFactor2 = distance2 > cutoffDistance2 ? std::sqrt(distance2 / cutoffDistance2) : 1;
-	unsigned slices = 60 / distanceFactor2;
-	if (size > 1) slices *= 2;
-	if (lowQuality) slices /= 3;
-	if (slices < 6) slices = 6;
-	gluSphere(gl::Quadric::quadric()->get(), size, slices, slices);
+		const unsigned n = size();
+		sourceMass.resize(n);
+		mobileX.resize(n);
+		mobileY.resize(n);
+		mobileZ.resize(n);
+		mobileMass.resize(n);
+		mobiles = 0;
+		for (unsigned i = 0; i < n; ++i) {
+			sourceMass[i] = frozen[i] ? 0 : mass[i];
+			if (!frozen[i]) {
+				mobileX[mobiles] = x[i];
+				mobileY[mobiles] = y[i];
+				mobileZ[mobiles] = z[i];
+				mobileMass[mobiles++] = mass[i];
+			}
+		}
+	}
 
-	if (gotTexture) {
-		gluQuadricTexture(gl::Quadric::quadric()->get(), 0);
-		glDisable(GL_TEXTURE_2D);
-		glPopMatrix();
+	if (solver == BARNES_HUT && fieldCells) {
+		tree<T>().update(&mobileX[0], &mobileY[0], &mobileZ[0],
+		                 &mobileMass[0], mobiles,
+		                 refitTolerance, arrangement);
+		return;
+	} else if (solver == BARNES_HUT) {
+		tree<T>().update(&x[0], &y[0], &z[0], &mass[0], size(),
+		                 refitTolerance, arrangement);
+		return;
+	} else if (solver == FMM) {
+		fmmAccelerationsAll();
+		return;
+	} else if (solver != SYMMETRIC) {
+		return;
 	}
 
-	if (!drawNames || distanceFactor2 >= 1.1f) {
+	/* Pairs are dealt into slots (one for each thread unless results
+	 * must not depend on their number), each accumulating
+	 * accelerations in its own arrays which are summed afterwards so
+	 * no two threads write to the same location. */
+	ThreadPool *const pool = ThreadPool::pool();
+	const unsigned n = size();
+	const unsigned slots = deterministic ? deterministicSlots : pool->size();
+	accumulators.assign(3 * n * slots, 0);
+	ax.resize(n);
+	ay.resize(n);
+	az.resize(n);
+
+	interactions += (unsigned long long)n * (n - 1);
+	pool->run(slots, [this, n, slots](unsigned begin, unsigned end) {
+		for (unsigned s = begin; s < end; ++s) {
+			symmetricAccelerations(s, slots, &accumulators[3 * n * s]);
+		}
+	});
+
+	pool->run(n, [this, n, slots](unsigned begin, unsigned end) {
+		const unsigned stride = 3 * n;
+		for (unsigned i = begin; i < end; ++i) {
+			const value_type *const acc = &accumulators[i];
+			ax[i] = treeSum(acc, slots, stride) * G;
+			ay[i] = treeSum(acc + n, slots, stride) * G;
+			az[i] = treeSum(acc + 2 * n, slots, stride) * G;
+			if (fieldCells && !frozen[i]) {
+				const Vector a = field.acceleration(getPosition(i));
+				ax[i] += a.x;
+				ay[i] += a.y;
+				az[i] += a.z;
+			}
+		}
+	});
+}
+
+template<class T>
+void BasicObjects<T>::fmmAccelerationsAll() const {
+	/* Frozen objects stay in the tree as massless bodies when their
+	 * field is cached so indexes need no mapping. */
+	const unsigned n = size();
+	ax.resize(n);
+	ay.resize(n);
+	az.resize(n);
+	fmm<T>().update(&x[0], &y[0], &z[0], sources(), n,
+	                refitTolerance, arrangement);
+	interactions +=
+		fmm<T>().accelerations(fmmOrder, theta, G, forceLaw, softening,
+		                       useKernel ? isa : kernel::detect(), rsqrt,
+		                       &ax[0], &ay[0], &az[0]);
+
+	if (!fieldCells) {
 		return;
 	}
+	ThreadPool::pool()->run(n, [this](unsigned begin, unsigned end) {
+		for (unsigned i = begin; i < end; ++i) {
+			if (frozen[i]) {
+				ax[i] = ay[i] = az[i] = 0;
+				continue;
+			}
+			const Vector a = field.acceleration(getPosition(i));
+			ax[i] += a.x;
+			ay[i] += a.y;
+			az[i] += a.z;
+		}
+	});
+}
+
+template<class T>
+void BasicObjects<T>::symmetricAccelerations(unsigned slot,
+                                             unsigned slots,
+                                             value_type *acc) const {
+	force::dispatch<T>(forceLaw, softening, [=](const auto &gravity) {
+		symmetricAccelerations(gravity, slot, slots, acc);
+	});
+}
+
+template<class T>
+template<class Force>
+void BasicObjects<T>::symmetricAccelerations(const Force &gravity,
+                                             unsigned slot,
+                                             unsigned slots,
+                                             value_type *accX) const {
+	value_type *const accY = accX + size(), *const accZ = accY + size();
+	const value_type *const m = sources();
+	const value_type minMass = force::minMass;
+
+	/* Rows are dealt cyclically since row i has n - i - 1 pairs; this
+	 * way each slot gets about the same number of pairs. */
+	for (unsigned i = slot, n = size(); i < n; i += slots) {
+		/* Object does not need acceleration if it is frozen and does
+		 * not cause any if it is too light. */
+		const bool needsI = !frozen[i], causesI = m[i] >= minMass;
+		if (!needsI && !causesI) continue;
+		const value_type px = x[i], py = y[i], pz = z[i];
+		value_type sx = 0, sy = 0, sz = 0;
+
+		for (unsigned j = i + 1; j < n; ++j) {
+			const value_type toI = needsI && m[j] >= minMass ? m[j] : 0;
+			const value_type toJ = causesI && !frozen[j] ? m[i] : 0;
+			if (!toI && !toJ) continue;
+
+			const value_type rx = x[j] - px, ry = y[j] - py, rz = z[j] - pz;
+			const value_type l2 = rx * rx + ry * ry + rz * rz;
+			if (gravity.skip(l2)) continue;
+
+			const value_type f = gravity.factor(l2);
+			const value_type fi = f * toI, fj = f * toJ;
+			sx += rx * fi; sy += ry * fi; sz += rz * fi;
+			accX[j] -= rx * fj; accY[j] -= ry * fj; accZ[j] -= rz * fj;
+		}
+
+		accX[i] += sx;
+		accY[i] += sy;
+		accZ[i] += sz;
+	}
+}
+
+/* Mixed precision makes sense only if objects are kept in double;
+ * float engine is single precision anyway. */
+template<class T>
+static void kernelAcceleration(const T *x, const T *y, const T *z,
+                               const T *mass, unsigned count,
+                               T px, T py, T pz, T out[3]) {
+	kernel::acceleration(ObjectsBase::isa, ObjectsBase::rsqrt,
+	                     ObjectsBase::forceLaw, ObjectsBase::softening,
+	                     x, y, z, mass, count, px, py, pz, out);
+}
+
+static void kernelAcceleration(const double *x, const double *y,
+                               const double *z, const double *mass,
+                               unsigned count,
+                               double px, double py, double pz,
+                               double out[3]) {
+	if (ObjectsBase::mixed) {
+		kernel::accelerationMixed(ObjectsBase::isa, ObjectsBase::rsqrt,
+		                          ObjectsBase::forceLaw,
+		                          ObjectsBase::softening,
+		                          x, y, z, mass, count, px, py, pz, out);
+	} else {
+		kernel::acceleration(ObjectsBase::isa, ObjectsBase::rsqrt,
+		                     ObjectsBase::forceLaw, ObjectsBase::softening,
+		                     x, y, z, mass, count, px, py, pz, out);
+	}
+}
+
+template<class T>
+typename BasicObjects<T>::Vector
+BasicObjects<T>::acceleration(unsigned i, unsigned long long &count) const {
+	/* SYMMETRIC and FMM add the field in prepareSolverAll(). */
+	if (solver == SYMMETRIC || solver == FMM) {
+		return Vector(ax[i], ay[i], az[i]);
+	}
+	const Vector a = solverAcceleration(i, count);
+	return fieldCells ? a + field.acceleration(getPosition(i)) : a;
+}
 
-	if (cam) {
-		glRotatef(cam->getRotY() * -MN_180_PI, 0, 1, 0);
+template<class T>
+typename BasicObjects<T>::Vector
+BasicObjects<T>::solverAcceleration(unsigned i,
+                                    unsigned long long &count) const {
+	if (solver == BARNES_HUT) {
+		return tree<T>().acceleration(getPosition(i), theta, G,
+		                              forceLaw, softening, count);
 	}
-	if (!textList) {
-		textList = glGenLists(1);
-		if (textList) glNewList(textList, GL_COMPILE);
-		glTranslatef(0, size + 0.3f, 0);
-		glScalef(0.1, 0.1, 0.1);
-		glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, materialColor);
-		glMaterialfv(GL_FRONT, GL_EMISSION, zeros);
-		t3d::draw3D(name, 0, 0, 0.5);
-		if (textList) {
-			glEndList();
-			glCallList(textList);
+
+	/* Kernel skips frozen objects if their field is cached. */
+	count += (fieldCells && useKernel ? mobiles : size()) - 1;
+	if (!useKernel) {
+		switch (summation) {
+		case SORTED:   return directAcceleration(i, sources());
+		case NEUMAIER: return compensatedAcceleration(i);
+		case PAIRWISE: return pairwiseAcceleration(i, 0, size());
 		}
+	}
+
+	value_type a[3];
+	if (fieldCells) {
+		kernelAcceleration(&mobileX[0], &mobileY[0], &mobileZ[0],
+		                   &mobileMass[0], mobiles, x[i], y[i], z[i], a);
 	} else {
-		glCallList(textList);
+		kernelAcceleration(&x[0], &y[0], &z[0], &mass[0], size(),
+		                   x[i], y[i], z[i], a);
 	}
+	return Vector(a[0], a[1], a[2]) * G;
 }
 
 
-namespace {
-	struct Acceleration {
-		Object::Vector vector;
-		Object::Vector::value_type value;
+template<class T>
+void BasicObjects<T>::solverErrorAll(value_type &max, value_type &rms) const {
+	prepareSolverAll();
+
+	value_type sum = 0;
+	unsigned count = 0;
+	max = 0;
+
+	for (unsigned i = 0, n = size(); i < n; ++i) {
+		if (frozen[i]) continue;
+		const Vector exact = directAcceleration(i);
+		const value_type length = exact.length();
+		if (length == 0) continue;
+		const value_type error =
+			(acceleration(i, interactions) - exact).length() / length;
+		max = std::max(max, error);
+		sum += error * error;
+		++count;
+	}
 
-		Acceleration(const Object::Vector &theVector,
-		             const Object::Vector::value_type &theValue)
-			: vector(theVector), value(theValue) { }
-		Acceleration(const Object::Vector &theVector)
-			: vector(theVector), value(theVector.length()) { }
+	rms = count ? std::sqrt(sum / count) : 0;
+}
 
-		bool operator<(const Acceleration &a) const {
-			return value < a.value;
+
+template<class T>
+void BasicObjects<T>::accelerationsAll() const {
+	prepareSolverAll();
+	accelerationsValid = true;
+	if (solver == SYMMETRIC || solver == FMM) {
+		evaluations += size();
+		return;
+	}
+
+	evaluations += size();
+	ax.resize(size());
+	ay.resize(size());
+	az.resize(size());
+	std::atomic<unsigned long long> total(0);
+	ThreadPool::pool()->run(size(), [this, &total](unsigned begin,
+	                                               unsigned end) {
+		unsigned long long count = 0;
+		for (unsigned i = begin; i < end; ++i) {
+			if (frozen[i]) continue;
+			const Vector a = acceleration(i, count);
+			ax[i] = a.x;
+			ay[i] = a.y;
+			az[i] = a.z;
 		}
-	};
+		total += count;
+	});
+	interactions += total;
 }
 
-void Object::tick_(Vector::value_type dt) {
-	static std::priority_queue<Acceleration> accelerations;
 
-	for (Object *o = next; o != this; o = o->next) {
-		if (o->mass < 0.01) continue;
-		const Vector r = o->point - point;
-		const Vector::value_type l2 = r.length2();
-		if (l2 < 0.01) continue;
-		Vector::value_type value = G * o->mass / l2;
-		accelerations.push(Acceleration(r * (value / sqrt(l2)), value));
+template<class T>
+void BasicObjects<T>::tickAll(value_type dt) {
+	ThreadPool *const pool = ThreadPool::pool();
+
+	if (integrator != BLOCK && integrator != HERMITE) {
+		jerksValid = false;
 	}
 
-	if (!accelerations.empty()) {
-		Vector a(0, 0, 0);
-		do {
-			a += accelerations.top().vector;
-			accelerations.pop();
-		} while (!accelerations.empty());
-		velocity += a * dt;
+	/* Tracers need positions of objects at both ends of the tick. */
+	driftTracersAll(dt);
+
+	switch (integrator) {
+	case EULER:
+		accelerationsAll();
+		pool->run(size(), [this, dt](unsigned begin, unsigned end) {
+			for (unsigned i = begin; i < end; ++i) {
+				if (frozen[i]) continue;
+				vx[i] += ax[i] * dt;
+				vy[i] += ay[i] * dt;
+				vz[i] += az[i] * dt;
+				nextX[i] = x[i] + vx[i] * dt;
+				nextY[i] = y[i] + vy[i] * dt;
+				nextZ[i] = z[i] + vz[i] * dt;
+			}
+		});
+		break;
+
+	case VERLET:
+		if (!accelerationsValid) {
+			accelerationsAll();
+		}
+
+		pool->run(size(), [this, dt](unsigned begin, unsigned end) {
+			const value_type half = dt / 2;
+			for (unsigned i = begin; i < end; ++i) {
+				if (frozen[i]) continue;
+				vx[i] += ax[i] * half;
+				vy[i] += ay[i] * half;
+				vz[i] += az[i] * half;
+				x[i] = nextX[i] = x[i] + vx[i] * dt;
+				y[i] = nextY[i] = y[i] + vy[i] * dt;
+				z[i] = nextZ[i] = z[i] + vz[i] * dt;
+			}
+		});
+
+		accelerationsAll();
+
+		pool->run(size(), [this, dt](unsigned begin, unsigned end) {
+			const value_type half = dt / 2;
+			for (unsigned i = begin; i < end; ++i) {
+				if (frozen[i]) continue;
+				vx[i] += ax[i] * half;
+				vy[i] += ay[i] * half;
+				vz[i] += az[i] * half;
+			}
+		});
+		break;
+
+	case BLOCK:
+		blockTick(dt, false);
+		break;
+
+	case HERMITE:
+		blockTick(dt, true);
+		break;
+	}
+
+	kickTracersAll(dt);
+}
+
+
+template<class T>
+T BasicObjects<T>::energyAll() const {
+	const unsigned n = size();
+	if (!n) {
+		return 0;
+	}
+
+	/* Energy of each object and of its pairs with objects of higher
+	 * indexes are calculated in parallel and summed in a fixed
+	 * order. */
+	std::vector<value_type> kinetic(n, 0), potential(n);
+	ThreadPool::pool()->run(n, [&](unsigned begin, unsigned end) {
+		force::dispatch<T>(forceLaw, softening, [&](const auto &gravity) {
+			for (unsigned i = begin; i < end; ++i) {
+				if (!frozen[i]) {
+					kinetic[i] = mass[i] * (vx[i] * vx[i] + vy[i] * vy[i] +
+					                        vz[i] * vz[i]) / 2;
+				}
+
+				NeumaierSum<T> sum;
+				for (unsigned j = i + 1; j < n; ++j) {
+					const value_type rx = x[j] - x[i], ry = y[j] - y[i];
+					const value_type rz = z[j] - z[i];
+					const value_type l2 = rx * rx + ry * ry + rz * rz;
+					if (!gravity.skip(l2)) {
+						sum += G * mass[i] * mass[j] * gravity.potential(l2);
+					}
+				}
+				potential[i] = sum.get();
+			}
+		});
+	});
+
+	return treeSum(&kinetic[0], n, 1) + treeSum(&potential[0], n, 1);
+}
+
+
+template<class T>
+void BasicObjects<T>::updatePointAll() {
+	for (unsigned i = 0, n = size(); i < n; ++i) {
+		if (!frozen[i]) {
+			x[i] = nextX[i];
+			y[i] = nextY[i];
+			z[i] = nextZ[i];
+		}
+	}
+
+	if (collisions) {
+		collideAll();
+	}
+
+	if (sortInterval && ++sinceSort >= sortInterval) {
+		sortAll();
 	}
-	nextPoint = point + velocity * dt;
 }
 
 
+template<class V>
+static unsigned long long bytes(const std::vector<V> &v) {
+	return v.capacity() * sizeof(V);
+}
+
+template<class T>
+unsigned long long BasicObjects<T>::memoryUsage() const {
+	unsigned long long total =
+		bytes(x) + bytes(y) + bytes(z) +
+		bytes(nextX) + bytes(nextY) + bytes(nextZ) +
+		bytes(vx) + bytes(vy) + bytes(vz) + bytes(mass) + bytes(sizes) +
+		bytes(frozen) + bytes(objects) + bytes(ids) +
+		bytes(ax) + bytes(ay) + bytes(az) +
+		bytes(jx) + bytes(jy) + bytes(jz) +
+		bytes(predX) + bytes(predY) + bytes(predZ) +
+		bytes(predVX) + bytes(predVY) + bytes(predVZ) +
+		bytes(level) + bytes(since) + bytes(accumulators) +
+		bytes(sourceMass) + bytes(mobileX) + bytes(mobileY) +
+		bytes(mobileZ) + bytes(mobileMass) + field.memoryUsage() +
+		bytes(tracerX) + bytes(tracerY) + bytes(tracerZ) +
+		bytes(tracerVX) + bytes(tracerVY) + bytes(tracerVZ) +
+		bytes(tracerAX) + bytes(tracerAY) + bytes(tracerAZ);
+	for (unsigned i = 0, n = size(); i < n; ++i) {
+		total += objects[i].name.capacity() + objects[i].texture.capacity();
+	}
+	return total;
+}
+
+
+
+template struct BasicObjects<float>;
+template struct BasicObjects<double>;
+template struct BasicObjects<long double>;
+
+
 }
 
 }
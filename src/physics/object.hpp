@@ -21,10 +21,13 @@
 #include <math.h>
 
 #include <string>
+#include <vector>
 
 #include "../common/color.hpp"
 #include "../common/vector.hpp"
-#include "../common/texture.hpp"
+#include "force.hpp"
+#include "frozen-field.hpp"
+#include "kernel.hpp"
 
 
 namespace mn {
@@ -32,100 +35,325 @@ namespace mn {
 namespace physics {
 
 
+/**
+ * Attributes of an object which simulation does not need.  Those are
+ * kept aside from positions, velocities and masses so that loops
+ * calculating forces do not have to drag them through cache.
+ */
 struct Object {
-	typedef gl::Vector<double> Vector;
+	explicit Object(const std::string &theName)
+		: name(theName), light(-1), color(gl::color()) { }
 
+	std::string name;
+	/** Number of the light object emits or -1 if none. */
+	int light;
+	gl::Color color;
+	/** Name of the texture to render object with or empty string. */
+	std::string texture;
+};
 
-	Object(const std::string &theName, Object *previous)
-		: mass(1), size(1), name(theName), light(-1), frozen(false),
-		  textList(0), next(this) {
-		setColor(1, 1, 1);
-		if (previous) {
-			next = previous->next;
-			previous->next = this;
-		}
-	}
 
-	const std::string &getName() const { return name; }
+/**
+ * Settings of the simulation shared by objects of all scalar types.
+ */
+struct ObjectsBase {
+	/** Value returned by find() if object was not found. */
+	static const unsigned none = ~0u;
+
+
+	/** Method used to calculate gravitational forces. */
+	enum Solver {
+		/** Sum over all pairs of objects; O(N^2) per tick. */
+		DIRECT,
+		/**
+		 * Sum over all pairs of objects visiting each unordered pair
+		 * once and applying opposite accelerations to both objects;
+		 * about half the work of DIRECT.
+		 */
+		SYMMETRIC,
+		/** Barnes-Hut octree approximation; O(N log N) per tick. */
+		BARNES_HUT,
+		/**
+		 * Fast multipole method (see Fmm) with expansions of order
+		 * #fmmOrder; O(N) per tick.
+		 */
+		FMM
+	};
+
+	/** Method used to integrate equations of motion. */
+	enum Integrator {
+		/**
+		 * Semi-implicit Euler method: velocity is updated first and
+		 * then used to update position.  One force evaluation per
+		 * tick.
+		 */
+		EULER,
+		/**
+		 * Kick-drift-kick leapfrog (velocity Verlet).  Symplectic and
+		 * second order so allows much bigger time steps.  Also one
+		 * force evaluation per tick as accelerations calculated at
+		 * the end of a tick are reused at the beginning of the next
+		 * one.
+		 */
+		VERLET,
+		/**
+		 * Hierarchical block time steps.  Each object gets its own
+		 * time step, tick length divided by a power of two, chosen
+		 * from ratio of its acceleration to jerk.  In each sub-step
+		 * forces are calculated only for objects whose step ends at
+		 * that time, from positions of other objects extrapolated
+		 * using their accelerations and jerks, and then corrected
+		 * like in HERMITE.  Forces are always calculated by direct
+		 * summation; configured solver is not used.
+		 */
+		BLOCK,
+		/**
+		 * Fourth order Hermite predictor-corrector.  Positions and
+		 * velocities are extrapolated using accelerations and jerks,
+		 * and then corrected using accelerations and jerks calculated
+		 * at the extrapolated positions.  One force evaluation per
+		 * tick; like BLOCK it always uses direct summation.
+		 */
+		HERMITE
+	};
+
+	static Integrator integrator;
+
+	/**
+	 * Accuracy parameter of BLOCK integrator; object's time step is
+	 * at most eta times its acceleration divided by its jerk.
+	 */
+	static double eta;
+
+	/** Tick is divided into at most 2^maxLevel sub-steps. */
+	static const unsigned maxLevel = 20;
+
+	static Solver solver;
+	/**
+	 * Opening angle of BARNES_HUT and FMM solvers; the lower, the
+	 * more accurate.
+	 */
+	static double theta;
+	/** Expansion order of FMM solver, from 1 to Fmm::maxOrder. */
+	static unsigned fmmOrder;
+	/**
+	 * How much trees of BARNES_HUT and FMM solvers may grow when they
+	 * are refitted to new positions of objects instead of being built
+	 * from scratch (see Octree::update() and Fmm::update()); zero
+	 * means they are rebuilt in each force evaluation.
+	 */
+	static double refitTolerance;
+
+	/**
+	 * Whether direct solver uses vectorised kernel with plain
+	 * summation instead of summing accelerations sorted by value.
+	 */
+	static bool useKernel;
+	/** Instruction set used by the kernel. */
+	static kernel::Isa isa;
+	/** Whether the kernel uses approximate reciprocal square root. */
+	static bool rsqrt;
+	/**
+	 * Whether the kernel calculates inverse distances in single
+	 * precision (see kernel::accelerationMixed()).  Used only by
+	 * objects kept in double precision.
+	 */
+	static bool mixed;
+
+	/** Way direct solver sums accelerations caused by other objects. */
+	enum Summation {
+		/**
+		 * Accelerations are sorted by value and summed starting from
+		 * the greatest.  Slow, as it needs a heap, but serves as
+		 * a reference for other methods.
+		 */
+		SORTED,
+		/** Kahan summation with Neumaier's improvement. */
+		NEUMAIER,
+		/** Recursive summation of halves of the set of objects. */
+		PAIRWISE
+	};
+
+	static Summation summation;
+
+	/**
+	 * Whether objects which touch each other are merged after each
+	 * tick (see BasicObjects::collideAll()).
+	 */
+	static bool collisions;
+
+	/** Force law objects interact with. */
+	static force::Law forceLaw;
+	/**
+	 * Softening length of the force law; 0.1 by default which with
+	 * NEWTON law gives the old behaviour of ignoring closer pairs.
+	 */
+	static double softening;
+
+	/**
+	 * Number of cells along the longest edge of the grid the field of
+	 * frozen objects is cached in (see FrozenField) or zero if the
+	 * field is summed over frozen objects each time like any other.
+	 * The cache is used by all solvers but not by BLOCK and HERMITE
+	 * integrators.
+	 */
+	static unsigned fieldCells;
+
+	/**
+	 * Number of ticks after which objects are sorted by Morton code
+	 * of their positions (see BasicObjects::sortAll()) or zero if they
+	 * are kept in the order they were added in.
+	 */
+	static unsigned sortInterval;
+
+	/**
+	 * Whether results must not depend on number of threads.  Most
+	 * solvers give the same results anyway; SYMMETRIC solver
+	 * normally has partial sums for each thread and in this mode
+	 * uses a fixed number of them instead (which costs memory when
+	 * there are fewer threads).
+	 */
+	static bool deterministic;
+
+	/**
+	 * Returns whether file is a snapshot saved by
+	 * BasicObjects::saveSnapshot() rather than a text description of
+	 * objects read by loadData().
+	 */
+	static bool isSnapshot(const char *filename);
+};
 
 
-	const Vector &getPosition() const { return point; }
-	Vector &getPosition() { return point; }
-	void setPosition(const Vector &thePoint) {
-		point = nextPoint = thePoint;
-	}
-	void setPosition(Vector::value_type x, Vector::value_type y, Vector::value_type z) {
-		point.x = nextPoint.x = x;
-		point.y = nextPoint.y = y;
-		point.z = nextPoint.z = z;
+/**
+ * A set of objects simulated together.  Properties used when
+ * calculating forces are stored in separate arrays (structure of
+ * arrays).  Each object is identified by its index which changes
+ * only when collideAll() removes merged objects or sortAll() reorders
+ * them; getId() returns an identifier which never changes.
+ *
+ * The template is instantiated for float, double and long double;
+ * float halves memory traffic and doubles width of the vectorised
+ * kernel while long double is meant for reference runs.
+ */
+template<class T>
+struct BasicObjects : public ObjectsBase {
+	typedef gl::Vector<T> Vector;
+	typedef T value_type;
+
+
+	unsigned size() const { return x.size(); }
+	bool empty() const { return x.empty(); }
+
+	/**
+	 * Adds a new object with given name placed in the origin, not
+	 * moving, with mass and size equal one.
+	 * \param name object's name.
+	 * \return index of the new object.
+	 */
+	unsigned add(const std::string &name);
+
+	/**
+	 * Looks for an object with given name.
+	 * \param name object's name.
+	 * \return object's index or #none if not found.
+	 */
+	unsigned find(const std::string &name) const;
+
+
+	Object &operator[](unsigned i) { return objects[i]; }
+	const Object &operator[](unsigned i) const { return objects[i]; }
+	const std::string &getName(unsigned i) const { return objects[i].name; }
+	/**
+	 * Returns identifier of i-th object, i.e. its index at the time
+	 * it was added.
+	 */
+	unsigned getId(unsigned i) const { return ids[i]; }
+
+	Vector getPosition(unsigned i) const { return Vector(x[i], y[i], z[i]); }
+	void setPosition(unsigned i, const Vector &point) {
+		x[i] = nextX[i] = point.x;
+		y[i] = nextY[i] = point.y;
+		z[i] = nextZ[i] = point.z;
+		accelerationsValid = jerksValid = fieldValid = tracersValid = false;
 	}
 
-	Vector &getVelocity() { return velocity; }
-	const Vector &getVelocity() const { return velocity; }
-	void setVelocity(const Vector &theVelocity) { velocity = theVelocity; }
-	void setVelocity(Vector::value_type x, Vector::value_type y, Vector::value_type z) {
-		velocity.x = x;
-		velocity.y = y;
-		velocity.z = z;
+	Vector getVelocity(unsigned i) const {
+		return Vector(vx[i], vy[i], vz[i]);
 	}
-
-	bool isFrozen() const { return frozen; }
-	void setFrozen(bool theFrozen) { frozen = theFrozen; }
-
-	Vector::value_type getMass() const { return mass; }
-	void setMass(Vector::value_type theMass) { mass = theMass; }
-
-	Vector::value_type getSize() const { return size; }
-	void setSize(Vector::value_type theSize) { size = theSize; }
-
-	void setColor(const gl::Color &theColor) {
-		materialColor[0] = theColor.r;
-		materialColor[1] = theColor.g;
-		materialColor[2] = theColor.b;
-		materialColor[3] = 1;
+	void setVelocity(unsigned i, const Vector &velocity) {
+		vx[i] = velocity.x;
+		vy[i] = velocity.y;
+		vz[i] = velocity.z;
 	}
 
-	void setColor(float r, float g, float b) {
-		materialColor[0] = r;
-		materialColor[1] = g;
-		materialColor[2] = b;
-		materialColor[3] = 1;
+	bool isFrozen(unsigned i) const { return frozen[i]; }
+	void setFrozen(unsigned i, bool theFrozen) {
+		frozen[i] = theFrozen;
+		accelerationsValid = jerksValid = fieldValid = tracersValid = false;
+		rearranged();
 	}
 
-
-	int getLight() const { return light; }
-	void setLight(int theLight) { light = theLight; }
-
-	static Vector::value_type cutoffDistance2;
-	static bool lowQuality, drawNames, useTextures;
-
-	void draw();
-	void drawAll() {
-		Object *o = this;
-		do o->draw(); while ((o = o->next) != this);
+	value_type getMass(unsigned i) const { return mass[i]; }
+	void setMass(unsigned i, value_type theMass) {
+		mass[i] = theMass;
+		accelerationsValid = jerksValid = fieldValid = tracersValid = false;
+		rearranged();
 	}
 
-	void tick(Vector::value_type dt) {
-		if (!frozen) {
-			tick_(dt);
-		}
+	value_type getSize(unsigned i) const { return sizes[i]; }
+	void setSize(unsigned i, value_type theSize) { sizes[i] = theSize; }
+
+
+	/**
+	 * Adds a tracer, a massless particle moved by gravity of objects
+	 * but exerting no force on anything.  Tracers are kept apart from
+	 * objects, have no names and are identified by index only; ticks
+	 * cost O(N * M) for N objects and M tracers.  Since there are
+	 * usually many more tracers then objects, their accelerations are
+	 * always summed by the vectorised kernel (see
+	 * kernel::accelerations()) with the best supported instruction
+	 * set, not by the configured solver and summation method.  #isa
+	 * and #rsqrt apply only if #useKernel is set, just like for
+	 * objects.  A tracer therefore follows the path of a massless
+	 * object only up to rounding errors.  Tracers are integrated
+	 * using kick-drift-kick leapfrog unless integrator is EULER, do
+	 * not collide and ignore #fieldCells.
+	 *
+	 * \param position tracer's position.
+	 * \param velocity tracer's velocity.
+	 * \return index of the new tracer.
+	 */
+	unsigned addTracer(const Vector &position, const Vector &velocity);
+
+	unsigned tracers() const { return tracerX.size(); }
+	Vector getTracerPosition(unsigned k) const {
+		return Vector(tracerX[k], tracerY[k], tracerZ[k]);
 	}
-	void tickAll(Vector::value_type dt) {
-		Object *o = this;
-		do o->tick(dt); while ((o = o->next) != this);
+	Vector getTracerVelocity(unsigned k) const {
+		return Vector(tracerVX[k], tracerVY[k], tracerVZ[k]);
 	}
 
-	void updatePoint() {
-		if (!frozen) {
-			point = nextPoint;
-		}
-	}
-	void updatePointAll() {
-		Object *o = this;
-		do o->updatePoint(); while ((o = o->next) != this);
-	}
 
-	void ticksAll(unsigned count, Vector::value_type dt) {
+	BasicObjects() : accelerationsValid(false), jerksValid(false),
+	                 fieldValid(false), mobiles(0), tracersValid(false),
+	                 evaluations(0), interactions(0), merges(0), nextId(0),
+	                 sinceSort(0), arrangement(++arrangements) { }
+
+
+	/**
+	 * Calculates velocities and next positions of all objects after
+	 * time \a dt.  Positions are not changed until updatePointAll()
+	 * is called (VERLET integrator updates them at once though).
+	 * Tracers are moved at once.
+	 */
+	void tickAll(value_type dt);
+	/**
+	 * Moves objects to positions calculated by tickAll() and, if
+	 * #collisions is set, merges objects which touch each other.
+	 * Every #sortInterval ticks objects are reordered as well.
+	 */
+	void updatePointAll();
+	void ticksAll(unsigned count, value_type dt) {
 		tickAll(dt);
 		while (--count) {
 			updatePointAll();
@@ -134,47 +362,237 @@ struct Object {
 	}
 
 
-	gl::Texture texture;
-	void colorFromTexture() {
-		if (texture) {
-			const gl::Color &avg = texture.getAverageColor();
-			materialColor[0] = avg.r;
-			materialColor[1] = avg.g;
-			materialColor[2] = avg.b;
-		}
-	}
+	/**
+	 * Returns number of times acceleration of an object was
+	 * calculated by any integrator since objects were created.
+	 */
+	unsigned long long getEvaluations() const { return evaluations; }
+
+	/**
+	 * Returns number of interactions calculated since objects were
+	 * created: of pairs of objects, of objects with tree nodes
+	 * (BARNES_HUT) and of pairs of tree nodes (FMM).  Attraction of
+	 * two objects counts twice as it accelerates both of them.
+	 */
+	unsigned long long getInteractions() const { return interactions; }
+
+	/**
+	 * Merges objects which touch each other, i.e. whose distance is
+	 * less then sum of their sizes, and removes merged objects from
+	 * arrays.  Object which absorbs the others is the frozen or the
+	 * heaviest one; it keeps its name and identifier.  Mass and
+	 * momentum are conserved, merged object is placed in the centre of
+	 * mass (unless it is frozen) and its volume is the sum of volumes.
+	 *
+	 * Candidate pairs are found using a uniform grid with cells four
+	 * times as big as the biggest object, hashed into a table, so it
+	 * takes O(N) time unless sizes of objects differ a lot.
+	 *
+	 * \return number of objects which were absorbed.
+	 */
+	unsigned collideAll();
+
+	/** Returns number of objects absorbed by collideAll() so far. */
+	unsigned long long getMerges() const { return merges; }
+
+	/**
+	 * Returns how many times tree of the configured solver, BARNES_HUT
+	 * or FMM, was built from scratch and how many times it was
+	 * refitted.  Trees are shared by all objects of the same type.
+	 *
+	 * \param builds location to save number of builds to.
+	 * \param refits location to save number of refits to.
+	 */
+	static void getTreeUpdates(unsigned long long &builds,
+	                           unsigned long long &refits);
+
+	/**
+	 * Sorts objects by Morton code (Z-order) of their positions so
+	 * that objects close in space are close in memory; tree builds
+	 * and walks of consecutive objects then touch the same cache
+	 * lines.  Objects keep their names and identifiers, so find() and
+	 * getId() still work, but their indexes change.  Called by
+	 * updatePointAll() every #sortInterval ticks.
+	 */
+	void sortAll();
+
+	/**
+	 * Saves objects, tracers and force law in a binary snapshot file
+	 * which can be loaded with loadSnapshot() to continue simulation.
+	 * The file is written to a temporary file first and then renamed
+	 * so that a crash leaves the previous snapshot intact.  Integrator
+	 * state (such as time step levels of BLOCK) is not saved.
+	 *
+	 * \param filename file to save snapshot in.
+	 * \param ticks number of ticks simulated so far.
+	 * \param dt length of a tick.
+	 * \return whether snapshot was saved; prints error message if not.
+	 */
+	bool saveSnapshot(const char *filename, unsigned long long ticks,
+	                  double dt) const;
+
+	/**
+	 * Loads objects saved by saveSnapshot() and sets #forceLaw and
+	 * #softening.  Whole file is read at once and arrays are copied
+	 * from it so loading takes time proportional to its size.
+	 * Snapshots written on machines with the other byte order are
+	 * converted but scalar type must match.
+	 *
+	 * \param filename file to load snapshot from.
+	 * \param ticks location to save number of simulated ticks to.
+	 * \param dt location to save length of a tick to.
+	 * \return loaded objects or NULL on error (message is printed).
+	 */
+	static BasicObjects *loadSnapshot(const char *filename,
+	                                  unsigned long long &ticks, double &dt);
+
+	/**
+	 * Exact acceleration of i-th object caused by all other objects.
+	 * Accelerations are summed using the SORTED method.
+	 */
+	Vector directAcceleration(unsigned i) const;
+
+	/**
+	 * Compares accelerations calculated by configured solver with
+	 * exact sums and returns maximal and root mean square relative
+	 * error over all objects which are not frozen.
+	 *
+	 * \param max location to save maximal relative error to.
+	 * \param rms location to save RMS of relative errors to.
+	 */
+	void solverErrorAll(value_type &max, value_type &rms) const;
+
+	/**
+	 * Returns total energy of the system, i.e. sum of kinetic energy
+	 * of all objects which are not frozen and potential energy of
+	 * all pairs of objects which are not too close to each other.
+	 */
+	value_type energyAll() const;
+
+	/**
+	 * Returns number of bytes allocated for per-object data,
+	 * including arrays used by solvers and integrators.
+	 */
+	unsigned long long memoryUsage() const;
+
+
+	static const value_type G;
 
 
-	Object *getNext() { return next; }
-	const Object *getNext() const { return next; }
-
-	Object *find(const std::string &theName) {
-		return const_cast<Object*>(const_cast<const Object*>(this)->find(theName));
-	}
-	const Object *find(const std::string &theName) const {
-		const Object *o = this;
-		do if (o->name == theName) return o; while ((o = o->next) != this);
-		return 0;
+private:
+	std::vector<value_type> x, y, z, nextX, nextY, nextZ, vx, vy, vz, mass;
+	std::vector<value_type> sizes;
+	std::vector<unsigned char> frozen;
+	std::vector<Object> objects;
+	std::vector<unsigned> ids;
+
+	/** Accelerations of objects in current positions. */
+	mutable std::vector<value_type> ax, ay, az;
+	/** Whether ax, ay and az match current positions. */
+	mutable bool accelerationsValid;
+
+	/** Jerks of objects in current positions (used by BLOCK). */
+	std::vector<value_type> jx, jy, jz;
+	/** Whether jx, jy and jz match current positions. */
+	bool jerksValid;
+
+	/** Field of frozen objects used if #fieldCells is not zero. */
+	mutable FrozenField<T> field;
+	/** Whether field matches current frozen objects. */
+	mutable bool fieldValid;
+	/**
+	 * Masses of objects with frozen ones zeroed; used by solvers in
+	 * place of mass if field is used.
+	 */
+	mutable std::vector<value_type> sourceMass;
+	/**
+	 * Positions and masses of objects which are not frozen packed at
+	 * the beginning of the arrays; used by the kernel and the octree
+	 * if field is used.
+	 */
+	mutable std::vector<value_type> mobileX, mobileY, mobileZ, mobileMass;
+	mutable unsigned mobiles;
+
+	/** Positions, velocities and accelerations of tracers. */
+	std::vector<value_type> tracerX, tracerY, tracerZ;
+	std::vector<value_type> tracerVX, tracerVY, tracerVZ;
+	std::vector<value_type> tracerAX, tracerAY, tracerAZ;
+	/** Whether tracer accelerations match current positions. */
+	bool tracersValid;
+
+	/** Positions and velocities extrapolated to a sub-step. */
+	std::vector<value_type> predX, predY, predZ, predVX, predVY, predVZ;
+	/** Time step level and time of last update of each object. */
+	std::vector<unsigned char> level;
+	std::vector<unsigned long> since;
+
+	mutable unsigned long long evaluations, interactions;
+	unsigned long long merges;
+	unsigned nextId;
+	/** Number of ticks since objects were last sorted. */
+	unsigned sinceSort;
+	/**
+	 * Identifies the set of objects and their order; changes when
+	 * objects are added, removed or reordered or when their masses or
+	 * frozen state change so that trees shared by all objects are
+	 * refitted only to objects they were built for.
+	 */
+	unsigned long long arrangement;
+	static unsigned long long arrangements;
+	void rearranged() { arrangement = ++arrangements; }
+	/** Partial sums of accelerations used by SYMMETRIC solver. */
+	mutable std::vector<value_type> accumulators;
+
+	const value_type *sources() const {
+		return fieldCells ? &sourceMass[0] : &mass[0];
 	}
 
-
-	static const Vector::value_type G;
+	/**
+	 * Calculates acceleration of i-th object adding number of
+	 * interactions it took to \a count.
+	 */
+	Vector acceleration(unsigned i, unsigned long long &count) const;
+	Vector solverAcceleration(unsigned i, unsigned long long &count) const;
+	Vector directAcceleration(unsigned i, const value_type *m) const;
+	Vector compensatedAcceleration(unsigned i) const;
+	Vector pairwiseAcceleration(unsigned i, unsigned begin,
+	                            unsigned end) const;
+	void prepareSolverAll() const;
+	void accelerationsAll() const;
+	void blockTick(value_type dt, bool shared);
+	void derivatives(const std::vector<unsigned> &targets);
+	template<class Force>
+	void derivatives(const Force &gravity,
+	                 const std::vector<unsigned> &targets,
+	                 unsigned begin, unsigned end);
+	unsigned blockLevel(unsigned i, value_type dt) const;
+	void tracerAccelerationsAll(const value_type *sx, const value_type *sy,
+	                            const value_type *sz);
+	void driftTracersAll(value_type dt);
+	void kickTracersAll(value_type dt);
+	void symmetricAccelerations(unsigned slot, unsigned slots,
+	                            value_type *acc) const;
+	template<class Force>
+	void symmetricAccelerations(const Force &gravity, unsigned slot,
+	                            unsigned slots, value_type *acc) const;
+	void fmmAccelerationsAll() const;
+};
 
 
-private:
-	Vector point, nextPoint, velocity;
-	Vector::value_type mass, size;
-	const std::string name;
-	int light;
-	bool frozen;
+extern template struct BasicObjects<float>;
+extern template struct BasicObjects<double>;
+extern template struct BasicObjects<long double>;
 
-	float materialColor[4];
-	unsigned int textList;
 
-	Object *next;
+#ifndef MN_PHYSICS_SCALAR
+#  define MN_PHYSICS_SCALAR double
+#endif
 
-	void tick_(Vector::value_type dt);
-};
+/**
+ * Objects simulated by the applications.  Scalar type can be chosen
+ * when building by defining MN_PHYSICS_SCALAR macro.
+ */
+typedef BasicObjects<MN_PHYSICS_SCALAR> Objects;
 
 
 }
@@ -0,0 +1,155 @@
+/*
+ * src/physics/octants.hpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef H_OCTANTS_HPP
+#define H_OCTANTS_HPP
+
+#include <vector>
+
+#include "../common/vector.hpp"
+#include "thread-pool.hpp"
+
+
+namespace mn {
+
+namespace physics {
+
+
+/**
+ * Partitioning of bodies into octants shared by Octree and Fmm.
+ * Octant number has bits 0, 1 and 2 set if body's x, y and z
+ * coordinate respectively is not less then the one of cube's centre.
+ */
+namespace octants {
+
+
+/**
+ * Bodies at (almost) the same position would make tree infinitely
+ * deep so splitting stops at this depth.
+ */
+const unsigned maxDepth = 32;
+
+
+/** Returns octant of a cube with given centre point lies in. */
+template<class T>
+inline unsigned octant(T x, T y, T z, const gl::Vector<T> &center) {
+	return (x >= center.x) | ((y >= center.y) << 1) | ((z >= center.z) << 2);
+}
+
+/**
+ * Returns centre of octant \a o of a cube.
+ * \param parent centre of the cube.
+ * \param half half of octant's width.
+ */
+template<class T>
+inline gl::Vector<T> center(const gl::Vector<T> &parent, T half,
+                             unsigned o) {
+	return parent + gl::Vector<T>(o & 1 ? half : -half,
+	                              o & 2 ? half : -half,
+	                              o & 4 ? half : -half);
+}
+
+
+/**
+ * Counting sort of bodies by octant.  Bodies keep their relative
+ * order within an octant.
+ *
+ * \param count number of bodies.
+ * \param octantOf function returning octant of i-th body.
+ * \param counts array of eight zeros to save number of bodies in each
+ *        octant to.
+ * \param order vector to save the new order to; j-th element is index
+ *        of the body which goes j-th.
+ */
+template<class Octant>
+void sort(unsigned count, const Octant &octantOf, unsigned *counts,
+          std::vector<unsigned> &order) {
+	std::vector<unsigned char> octants(count);
+	for (unsigned i = 0; i < count; ++i) {
+		octants[i] = octantOf(i);
+		++counts[octants[i]];
+	}
+
+	unsigned offsets[8];
+	for (unsigned o = 0, sum = 0; o < 8; sum += counts[o++]) {
+		offsets[o] = sum;
+	}
+
+	order.resize(count);
+	for (unsigned i = 0; i < count; ++i) {
+		order[offsets[octants[i]]++] = i;
+	}
+}
+
+/** Reorders elements of an array as given by order made by sort(). */
+template<class V>
+void permute(V *data, const std::vector<unsigned> &order) {
+	const std::vector<V> copy(data, data + order.size());
+	for (unsigned j = 0; j < order.size(); ++j) {
+		data[j] = copy[order[j]];
+	}
+}
+
+
+/**
+ * Builds a tree level by level starting at the root whose index must
+ * be zero.  Nodes of a level are split in parallel, as each of them
+ * moves only its own bodies, and their children are added afterwards.
+ *
+ * \param levels vector to save indexes of nodes at each depth to.
+ * \param split function called as split(node, depth, counts) which
+ *        sorts bodies of a node by octant unless it is a leaf; counts
+ *        is an array of eight zeros to save number of bodies in each
+ *        octant to.
+ * \param addChildren function called as addChildren(node, counts,
+ *        next) for each node of a level, in order, which adds
+ *        children of non-empty octants to the tree and appends their
+ *        indexes to next.
+ */
+template<class Split, class AddChildren>
+void build(std::vector<std::vector<unsigned> > &levels, const Split &split,
+           const AddChildren &addChildren) {
+	ThreadPool *const pool = ThreadPool::pool();
+	levels.assign(1, std::vector<unsigned>(1, 0));
+	std::vector<unsigned> counts, next;
+	for (unsigned depth = 0; depth < levels.size(); ++depth) {
+		const std::vector<unsigned> &level = levels[depth];
+		counts.assign(8 * level.size(), 0);
+		pool->run(level.size(), [&](unsigned begin, unsigned end) {
+			for (unsigned k = begin; k < end; ++k) {
+				split(level[k], depth, &counts[8 * k]);
+			}
+		});
+
+		next.clear();
+		for (unsigned k = 0; k < level.size(); ++k) {
+			addChildren(level[k], &counts[8 * k], next);
+		}
+		if (!next.empty()) {
+			levels.push_back(next);
+		}
+	}
+}
+
+
+}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,303 @@
+/*
+ * src/physics/octree.cpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "octree.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "octants.hpp"
+
+
+namespace mn {
+
+namespace physics {
+
+
+template<class T>
+void Octree<T>::build(const value_type *x, const value_type *y,
+                      const value_type *z, const value_type *theMasses,
+                      unsigned count) {
+	key = 0;
+	nodes.clear();
+	points.clear();
+	masses.clear();
+	index.clear();
+	inputCount = count;
+	builtSize = 0;
+	++builds;
+
+	Vector min, max;
+	for (unsigned i = 0; i < count; ++i) {
+		if (theMasses[i] < force::minMass) continue;
+		const Vector p(x[i], y[i], z[i]);
+		if (points.empty()) {
+			min = max = p;
+		} else {
+			min.x = std::min(min.x, p.x); max.x = std::max(max.x, p.x);
+			min.y = std::min(min.y, p.y); max.y = std::max(max.y, p.y);
+			min.z = std::min(min.z, p.z); max.z = std::max(max.z, p.z);
+		}
+		points.push_back(p);
+		masses.push_back(theMasses[i]);
+		index.push_back(i);
+	}
+
+	if (points.empty()) {
+		return;
+	}
+
+	const Vector size = max - min;
+	Node root;
+	root.center = (min + max) * 0.5;
+	root.half = std::max(std::max(size.x, size.y), size.z) * 0.5 + 0.5;
+	root.first = 0;
+	root.count = points.size();
+	nodes.push_back(root);
+
+	/* Sizes of nodes split so far; see update(). */
+	std::vector<value_type> sizes(1);
+	std::vector<std::vector<unsigned> > levels;
+	octants::build(levels,
+	               [this, &sizes](unsigned node, unsigned depth,
+	                              unsigned *counts) {
+		sizes[node] = splitNode(node, depth, counts);
+	}, [this, &sizes](unsigned node, const unsigned *counts,
+	                  std::vector<unsigned> &next) {
+		const Vector center = nodes[node].center;
+		const value_type half = nodes[node].half * 0.5;
+		unsigned start = nodes[node].first;
+		builtSize += sizes[node];
+
+		for (unsigned o = 0; o < 8; start += counts[o++]) {
+			if (!counts[o]) continue;
+
+			Node child;
+			child.center = octants::center(center, half, o);
+			child.half = half;
+			child.first = start;
+			child.count = counts[o];
+
+			nodes[node].children[o] = nodes.size();
+			next.push_back(nodes.size());
+			nodes.push_back(child);
+		}
+		sizes.resize(nodes.size());
+	});
+}
+
+
+template<class T>
+typename Octree<T>::value_type
+Octree<T>::splitNode(unsigned node, unsigned depth, unsigned *counts) {
+	const unsigned first = nodes[node].first, count = nodes[node].count;
+	const Vector center = nodes[node].center;
+
+	value_type mass = 0;
+	Vector moment, min = points[first], max = min;
+	for (unsigned i = first; i < first + count; ++i) {
+		mass += masses[i];
+		moment += points[i] * masses[i];
+		min.x = std::min(min.x, points[i].x);
+		max.x = std::max(max.x, points[i].x);
+		min.y = std::min(min.y, points[i].y);
+		max.y = std::max(max.y, points[i].y);
+		min.z = std::min(min.z, points[i].z);
+		max.z = std::max(max.z, points[i].z);
+	}
+	nodes[node].mass = mass;
+	nodes[node].massCenter = moment / mass;
+	memset(nodes[node].children, 0, sizeof nodes[node].children);
+
+	/* What refit() would make of the node; see update(). */
+	const Vector size = max - min;
+	const value_type half = std::max(std::max(size.x, size.y), size.z) * 0.5;
+
+	if (count <= leafSize || depth >= octants::maxDepth) {
+		return half;
+	}
+
+	std::vector<unsigned> order;
+	const Vector *const p = &points[first];
+	octants::sort(count, [p, &center](unsigned i) {
+		return octants::octant(p[i].x, p[i].y, p[i].z, center);
+	}, counts, order);
+	octants::permute(&points[first], order);
+	octants::permute(&masses[first], order);
+	octants::permute(&index[first], order);
+	return half;
+}
+
+
+template<class T>
+void Octree<T>::update(const value_type *x, const value_type *y,
+                       const value_type *z, const value_type *theMasses,
+                       unsigned count, value_type tolerance,
+                       unsigned long long theKey) {
+	if (tolerance > 0 && theKey && theKey == key &&
+	    refit(x, y, z, theMasses, count, tolerance)) {
+		++refits;
+	} else {
+		build(x, y, z, theMasses, count);
+	}
+	key = theKey;
+}
+
+
+template<class T>
+bool Octree<T>::refit(const value_type *x, const value_type *y,
+                      const value_type *z, const value_type *theMasses,
+                      unsigned count, value_type tolerance) {
+	if (nodes.empty() || count != inputCount) {
+		return false;
+	}
+
+	/* Tree's bodies must be exactly the heavy ones. */
+	unsigned heavy = 0;
+	for (unsigned i = 0; i < count; ++i) {
+		heavy += theMasses[i] >= force::minMass;
+	}
+	if (heavy != points.size()) {
+		return false;
+	}
+	for (unsigned k = 0; k < heavy; ++k) {
+		const unsigned i = index[k];
+		if (theMasses[i] < force::minMass) {
+			return false;
+		}
+		points[k] = Vector(x[i], y[i], z[i]);
+		masses[k] = theMasses[i];
+	}
+
+	/* Children always come after their parent so going backwards
+	 * visits them first. */
+	std::vector<Vector> mins(nodes.size()), maxs(nodes.size());
+	value_type size = 0;
+	for (unsigned n = nodes.size(); n--; ) {
+		Node &node = nodes[n];
+		value_type mass = 0;
+		Vector moment(0, 0, 0), min = points[node.first], max = min;
+		bool leaf = true;
+
+		for (unsigned o = 0; o < 8; ++o) {
+			const unsigned c = node.children[o];
+			if (!c) continue;
+			mass += nodes[c].mass;
+			moment += nodes[c].massCenter * nodes[c].mass;
+			min.x = std::min(min.x, mins[c].x);
+			max.x = std::max(max.x, maxs[c].x);
+			min.y = std::min(min.y, mins[c].y);
+			max.y = std::max(max.y, maxs[c].y);
+			min.z = std::min(min.z, mins[c].z);
+			max.z = std::max(max.z, maxs[c].z);
+			leaf = false;
+		}
+
+		if (leaf) {
+			for (unsigned i = node.first; i < node.first + node.count; ++i) {
+				const Vector &p = points[i];
+				mass += masses[i];
+				moment += p * masses[i];
+				min.x = std::min(min.x, p.x); max.x = std::max(max.x, p.x);
+				min.y = std::min(min.y, p.y); max.y = std::max(max.y, p.y);
+				min.z = std::min(min.z, p.z); max.z = std::max(max.z, p.z);
+			}
+		}
+
+		const Vector extent = max - min;
+		node.mass = mass;
+		node.massCenter = moment / mass;
+		node.center = (min + max) * 0.5;
+		node.half = std::max(std::max(extent.x, extent.y), extent.z) * 0.5;
+		mins[n] = min;
+		maxs[n] = max;
+		size += node.half;
+	}
+
+	return size <= builtSize * (1 + tolerance);
+}
+
+
+template<class T>
+typename Octree<T>::Vector
+Octree<T>::acceleration(const Vector &point, value_type theta,
+                        value_type G, force::Law law,
+                        value_type softening,
+                        unsigned long long &interactions) const {
+	if (nodes.empty()) {
+		return Vector(0, 0, 0);
+	}
+	return force::dispatch<T>(law, softening, [&](const auto &gravity) {
+		return acceleration(nodes[0], point, theta * theta, gravity,
+		                    interactions) * G;
+	});
+}
+
+
+template<class T>
+template<class Force>
+typename Octree<T>::Vector
+Octree<T>::acceleration(const Node &node, const Vector &point,
+                        value_type theta2, const Force &gravity,
+                        unsigned long long &interactions) const {
+	const Vector d = point - node.center;
+	const bool inside = std::fabs(d.x) <= node.half &&
+		std::fabs(d.y) <= node.half && std::fabs(d.z) <= node.half;
+	const Vector r = node.massCenter - point;
+	const value_type l2 = r.length2();
+	const value_type width2 = 4 * node.half * node.half;
+
+	if (!inside && !gravity.skip(l2) && width2 < theta2 * l2) {
+		++interactions;
+		return r * (node.mass * gravity.factor(l2));
+	}
+
+	Vector a(0, 0, 0);
+	bool leaf = true;
+	for (unsigned o = 0; o < 8; ++o) {
+		if (node.children[o]) {
+			a += acceleration(nodes[node.children[o]], point, theta2,
+			                  gravity, interactions);
+			leaf = false;
+		}
+	}
+
+	if (leaf) {
+		for (unsigned i = node.first; i < node.first + node.count; ++i) {
+			const Vector r = points[i] - point;
+			const value_type l2 = r.length2();
+			if (gravity.skip(l2)) continue;
+			a += r * (masses[i] * gravity.factor(l2));
+			++interactions;
+		}
+	}
+
+	return a;
+}
+
+
+
+template struct Octree<float>;
+template struct Octree<double>;
+template struct Octree<long double>;
+
+
+}
+
+}
@@ -0,0 +1,164 @@
+/*
+ * src/physics/octree.hpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef H_OCTREE_HPP
+#define H_OCTREE_HPP
+
+#include <vector>
+
+#include "../common/vector.hpp"
+#include "force.hpp"
+
+
+namespace mn {
+
+namespace physics {
+
+
+/**
+ * A Barnes-Hut octree.  Tree is built from a set of point masses and
+ * then used to approximate gravitational acceleration in any point of
+ * space.  Each node keeps total mass and centre of mass of bodies
+ * inside of it so a distant node can be treated as a single body.
+ * Instantiated for float, double and long double.
+ */
+template<class T>
+struct Octree {
+	typedef gl::Vector<T> Vector;
+	typedef T value_type;
+
+	/** Maximal number of bodies kept in a single leaf. */
+	static const unsigned leafSize = 8;
+
+	/**
+	 * Builds the tree from scratch.  Bodies with mass lower then
+	 * force::minMass are ignored (just like direct summation does).
+	 *
+	 * \param x x coordinates of bodies.
+	 * \param y y coordinates of bodies.
+	 * \param z z coordinates of bodies.
+	 * \param masses masses of bodies.
+	 * \param count number of bodies.
+	 */
+	void build(const value_type *x, const value_type *y,
+	           const value_type *z, const value_type *masses,
+	           unsigned count);
+
+	/**
+	 * Updates the tree after bodies moved.  If the same bodies are
+	 * heavy enough as when the tree was built, keeps the structure
+	 * and refits it: bounds of each node are shrunk or grown to the
+	 * bounding cube of its bodies and masses and centres of mass are
+	 * recalculated bottom-up in O(N).  Refitted nodes grow as bodies
+	 * move apart which makes walks slower, so if sum of their sizes
+	 * exceeds the sum at the time of building by more than \a
+	 * tolerance times, the tree is built from scratch instead.
+	 *
+	 * \param x x coordinates of bodies.
+	 * \param y y coordinates of bodies.
+	 * \param z z coordinates of bodies.
+	 * \param masses masses of bodies.
+	 * \param count number of bodies.
+	 * \param tolerance allowed relative growth of the tree; if not
+	 *        positive tree is always built from scratch.
+	 * \param key identifies the bodies and their order; tree is
+	 *        refitted only if it equals non-zero key given to the
+	 *        previous update() since then the tree was built.
+	 */
+	void update(const value_type *x, const value_type *y,
+	            const value_type *z, const value_type *masses,
+	            unsigned count, value_type tolerance,
+	            unsigned long long key);
+
+	/** Returns how many times tree was built from scratch. */
+	unsigned long long getBuilds() const { return builds; }
+	/** Returns how many times tree was refitted by update(). */
+	unsigned long long getRefits() const { return refits; }
+
+	/**
+	 * Approximates acceleration in a given point.  Node is opened if
+	 * point lies inside of it or if its width divided by distance to
+	 * its centre of mass is not less then \a theta.
+	 *
+	 * \param point point to calculate acceleration in.
+	 * \param theta opening angle; zero gives exact sum.
+	 * \param G gravitational constant.
+	 * \param law force law.
+	 * \param softening softening length of the law.
+	 * \param interactions number of nodes and bodies whose attraction
+	 *        was calculated is added to it.
+	 */
+	Vector acceleration(const Vector &point, value_type theta,
+	                    value_type G, force::Law law,
+	                    value_type softening,
+	                    unsigned long long &interactions) const;
+
+	bool empty() const { return nodes.empty(); }
+
+	Octree() : inputCount(0), builtSize(0), builds(0), refits(0), key(0) { }
+
+private:
+	struct Node {
+		Vector center, massCenter;
+		value_type half, mass;
+		/** Range of bodies in the tree's body arrays. */
+		unsigned first, count;
+		/** Indexes of children or zero (root is never a child). */
+		unsigned children[8];
+	};
+
+	std::vector<Node> nodes;
+	std::vector<Vector> points;
+	std::vector<value_type> masses;
+	/** Index of each body in arrays passed to build(). */
+	std::vector<unsigned> index;
+	/** Number of bodies passed to build(). */
+	unsigned inputCount;
+	/** Sum of halves of bounding cubes of nodes' bodies after build. */
+	value_type builtSize;
+	unsigned long long builds, refits;
+	/** Key given to the last update() or zero after build(). */
+	unsigned long long key;
+
+	/**
+	 * Calculates mass, centre of mass and size of a node and, unless
+	 * it is a leaf, sorts its bodies by octant.
+	 * \param counts array of eight zeros to save number of bodies in
+	 *        each octant to; left intact for leaves.
+	 * \return half of width of bounding cube of node's bodies.
+	 */
+	value_type splitNode(unsigned node, unsigned depth, unsigned *counts);
+	bool refit(const value_type *x, const value_type *y,
+	           const value_type *z, const value_type *masses,
+	           unsigned count, value_type tolerance);
+	template<class Force>
+	Vector acceleration(const Node &node, const Vector &point,
+	                    value_type theta2, const Force &gravity,
+	                    unsigned long long &interactions) const;
+};
+
+
+extern template struct Octree<float>;
+extern template struct Octree<double>;
+extern template struct Octree<long double>;
+
+
+}
+
+}
+
+#endif
@@ -25,6 +25,8 @@
 #include <string.h>
 #include <getopt.h>
 
+#include <algorithm>
+#include <cmath>
 #include <vector>
 #include <limits>
 #include <random>
@@ -42,7 +44,12 @@
 #include "../common/quadric.hpp"
 #include "../common/texture.hpp"
 #include "../common/mconst.h"
+#include "fmm.hpp"
 #include "object.hpp"
+#include "render.hpp"
+#include "report.hpp"
+#include "simulation.hpp"
+#include "thread-pool.hpp"
 #include "data-loader.hpp"
 
 
@@ -76,8 +83,13 @@ namespace mn {
  */
 namespace physics {
 
-static Object *objects;
-static const Object *tabPosition = 0;
+static Objects *objects;
+static Renderer *renderer;
+static Simulation *simulation;
+/** Identifier of object camera follows and whether Tab was pressed. */
+static unsigned tabId = Objects::none;
+static bool tabPressed = false;
+static Objects::value_type timeStep = 1/250.0f;
 static bool headlight = true, displayStars = true;
 static gl::Texture starsTexture(GL_LUMINANCE, GL_LUMINANCE);
 
@@ -87,19 +99,23 @@ static void handleKeyboard(unsigned key, bool down, int x, int y) {
 	if (!down) return;
 	switch (key) {
 	case 27: /* Escape */
+		simulation->stop();
+		if (Simulation::snapshotFile) {
+			simulation->saveSnapshot();
+		}
 		exit(0);
 
 	case '\t':
-		tabPosition = (tabPosition ? tabPosition : objects)->getNext();
+		tabPressed = true;
 		gl::Camera::camera->moved = false;
 		break;
 
 	case 'x': case 'X':
-		Object::useTextures = !Object::useTextures;
+		Renderer::useTextures = !Renderer::useTextures;
 		break;
 
 	case 'c': case 'C':
-		Object::lowQuality = !Object::lowQuality;
+		Renderer::lowQuality = !Renderer::lowQuality;
 		break;
 
 	case 'v': case 'V':
@@ -107,7 +123,7 @@ static void handleKeyboard(unsigned key, bool down, int x, int y) {
 		break;
 
 	case 'n': case 'N':
-		Object::drawNames = !Object::drawNames;
+		Renderer::drawNames = !Renderer::drawNames;
 		break;
 
 	case 'j': case 'J':
@@ -211,9 +227,32 @@ static void drawScene() {
 	glLoadIdentity();
 
 	mn::gl::Camera &camera = *mn::gl::Camera::camera;
+	const Simulation::State &state = simulation->state();
+
+	/* Objects may merge or be reordered so the one camera follows is
+	 * looked up by its identifier in each frame and Tab goes to the
+	 * object with the next identifier, i.e. in order of the data file. */
+	if (tabPressed && !state.ids.empty()) {
+		unsigned next = Objects::none, first = Objects::none;
+		for (unsigned i = 0, n = state.ids.size(); i < n; ++i) {
+			const unsigned id = state.ids[i];
+			first = std::min(first, id);
+			if (id > tabId) {
+				next = std::min(next, id);
+			}
+		}
+		tabId = next == Objects::none ? first : next;
+	}
+	tabPressed = false;
 
-	if (!camera.moved && tabPosition) {
-		camera.setEye(tabPosition->getPosition());
+	unsigned tabPosition = std::find(state.ids.begin(), state.ids.end(),
+	                                 tabId) - state.ids.begin();
+	if (tabPosition == state.ids.size()) {
+		tabPosition = tabId = Objects::none;
+	}
+
+	if (!camera.moved && tabPosition != Objects::none) {
+		camera.setEye(state.positions[tabPosition]);
 		camera.moveZ(5);
 		camera.moved = false;
 	}
@@ -231,9 +270,10 @@ static void drawScene() {
 		glEnable(GL_CULL_FACE);
 		glEnable(GL_LIGHTING);
 
-		objects->drawAll();
+		renderer->drawAll(state.ids, state.positions, state.sizes);
 
 		glDisable(GL_LIGHTING);
+		renderer->drawTracers(state.tracers);
 		glDisable(GL_CULL_FACE);
 		glDisable(GL_DEPTH_TEST);
 	}
@@ -275,12 +315,12 @@ static void drawScene() {
 	                camera.getRotX()*MN_180_PI, camera.getRotY()*MN_180_PI, 0.0,
 	                fps,
 	                mn::gl::Camera::countTicks*mn::gl::Camera::tickIncrement/10.0f);
-	if (tabPosition) {
-		const Object::Vector &pos = tabPosition->getPosition();
-		const Object::Vector &vel = tabPosition->getVelocity();
+	if (tabPosition != Objects::none) {
+		const gl::Vector<double> pos = state.positions[tabPosition];
+		const gl::Vector<double> vel = state.velocities[tabPosition];
 		sprintf(buffer + i,
 		        "\n\n%s\nr = (%6.2f, %6.2f, %6.2f)\nV = (%6.2f, %6.2f, %6.2f)",
-		        tabPosition->getName().c_str(),
+		        renderer->getObject(tabId).name.c_str(),
 		        pos.x, pos.y, pos.z, vel.x, vel.y, vel.z);
 	}
 	glColor3f(1, 1, 1);
@@ -291,11 +331,7 @@ static void drawScene() {
 
 	glutSwapBuffers();
 
-
-	if (gl::Camera::countTicks && gl::Camera::tickIncrement) {
-		objects->ticksAll(gl::Camera::tickIncrement, 1/250.0f);
-		objects->updatePointAll();
-	}
+	simulation->setSpeed(gl::Camera::countTicks ? gl::Camera::tickIncrement : 0);
 }
 
 }
@@ -317,21 +353,179 @@ int main(int argc, char** argv) {
 		{ "no-names",    0, 0, 'n' },
 		{ "no-light",    0, 0, 'j' },
 		{ "no-stars",    0, 0, 'm' },
+		{ "barnes-hut",  2, 0, 'b' },
+		{ "symmetric",   0, 0, 'p' },
+		{ "fmm",         2, 0, 'f' },
+		{ "theta",       1, 0, 'T' },
+		{ "refit",       2, 0, 'u' },
+		{ "threads",     1, 0, 't' },
+		{ "simd",        2, 0, 's' },
+		{ "rsqrt",       0, 0, 'r' },
+		{ "mixed",       0, 0, 'M' },
+		{ "sum",         1, 0, 'a' },
+		{ "integrator",  1, 0, 'i' },
+		{ "collisions",  0, 0, 'C' },
+		{ "frozen-field",2, 0, 'F' },
+		{ "morton",      2, 0, 'z' },
+		{ "deterministic",0,0, 'D' },
+		{ "dt",          1, 0, 'd' },
+		{ "snapshot",    1, 0, 'S' },
+		{ "snapshot-every",1,0, 'E' },
+		{ "energy-drift",2, 0, 'e' },
+		{ "benchmark",   2, 0, 'B' },
+		{ "precision-report", 2, 0, 'R' },
+		{ "fmm-report",  0, 0, 'O' },
 		{ "help",        0, 0, '?' },
 		{ 0, 0, 0, 0 }
 	};
 	int opt, quality = 3;
-	while ((opt = getopt_long(argc, argv, "0123?xcbnjmH", longopts, 0))!=-1){
+	unsigned energyDriftTicks = 0;
+	double benchmarkError = 0;
+	unsigned precisionTicks = 0;
+	bool fmmReport = false;
+	while ((opt = getopt_long(argc, argv, "0123?xcb::pf::T:u::t:s::rMa:i:CF::z::Dd:S:E:e::B::R::OnjmH", longopts, 0))!=-1){
 		switch (opt) {
 		case '0':
 		case '1':
 		case '2':
 		case '3': quality = opt - '1'; break;
-		case 'x': mn::physics::Object::useTextures = false; break;
-		case 'c': mn::physics::Object::lowQuality  = true ; break;
-		case 'n': mn::physics::Object::drawNames   = false; break;
+		case 'x': mn::physics::Renderer::useTextures = false; break;
+		case 'c': mn::physics::Renderer::lowQuality  = true ; break;
+		case 'n': mn::physics::Renderer::drawNames   = false; break;
 		case 'j': mn::physics::headlight = false; break;
 		case 'm': mn::physics::displayStars = false; break;
+		case 'b':
+			mn::physics::Objects::solver = mn::physics::Objects::BARNES_HUT;
+			if (optarg) {
+				mn::physics::Objects::theta = atof(optarg);
+				if (!(mn::physics::Objects::theta > 0)) {
+					fprintf(stderr, "%s: invalid opening angle\n", optarg);
+					return 1;
+				}
+			}
+			break;
+		case 'p':
+			mn::physics::Objects::solver = mn::physics::Objects::SYMMETRIC;
+			break;
+		case 'f':
+			mn::physics::Objects::solver = mn::physics::Objects::FMM;
+			if (optarg) {
+				mn::physics::Objects::fmmOrder = atoi(optarg);
+				if (mn::physics::Objects::fmmOrder < 1 ||
+				    mn::physics::Objects::fmmOrder >
+				    mn::physics::Fmm<double>::maxOrder) {
+					fprintf(stderr, "%s: invalid expansion order\n", optarg);
+					return 1;
+				}
+			}
+			break;
+		case 'T':
+			mn::physics::Objects::theta = atof(optarg);
+			if (!(mn::physics::Objects::theta > 0)) {
+				fprintf(stderr, "%s: invalid opening angle\n", optarg);
+				return 1;
+			}
+			break;
+		case 'u':
+			mn::physics::Objects::refitTolerance = optarg ? atof(optarg) : 0.2;
+			if (!(mn::physics::Objects::refitTolerance > 0)) {
+				fprintf(stderr, "%s: invalid tolerance\n", optarg);
+				return 1;
+			}
+			break;
+		case 't':
+			if (!mn::physics::ThreadPool::parseThreads(optarg,
+			                       mn::physics::ThreadPool::threads)) {
+				fprintf(stderr, "%s: invalid number of threads\n", optarg);
+				return 1;
+			}
+			break;
+		case 's':
+			if (!mn::physics::kernel::parse(optarg ? optarg : "auto",
+			                                 mn::physics::Objects::isa)) {
+				fprintf(stderr, "%s: unsupported instruction set\n", optarg);
+				return 1;
+			}
+			mn::physics::Objects::useKernel = true;
+			break;
+		case 'r':
+			mn::physics::Objects::rsqrt = true;
+			break;
+		case 'M':
+			if (!mn::physics::Objects::useKernel) {
+				mn::physics::kernel::parse("auto", mn::physics::Objects::isa);
+				mn::physics::Objects::useKernel = true;
+			}
+			mn::physics::Objects::mixed = true;
+			break;
+		case 'a':
+			if (!strcmp(optarg, "sorted")) {
+				mn::physics::Objects::summation = mn::physics::Objects::SORTED;
+			} else if (!strcmp(optarg, "neumaier")) {
+				mn::physics::Objects::summation = mn::physics::Objects::NEUMAIER;
+			} else if (!strcmp(optarg, "pairwise")) {
+				mn::physics::Objects::summation = mn::physics::Objects::PAIRWISE;
+			} else {
+				fprintf(stderr, "%s: unknown summation method\n", optarg);
+				return 1;
+			}
+			break;
+		case 'i':
+			if (!mn::physics::parseIntegrator(optarg,
+			                                  mn::physics::Objects::integrator)) {
+				fprintf(stderr, "%s: unknown integrator\n", optarg);
+				return 1;
+			}
+			break;
+		case 'C':
+			mn::physics::Objects::collisions = true;
+			break;
+		case 'F':
+			mn::physics::Objects::fieldCells = optarg ? atoi(optarg) : 64;
+			if (!mn::physics::Objects::fieldCells) {
+				fprintf(stderr, "%s: invalid number of cells\n", optarg);
+				return 1;
+			}
+			break;
+		case 'z':
+			mn::physics::Objects::sortInterval = optarg ? atoi(optarg) : 100;
+			if (!mn::physics::Objects::sortInterval) {
+				fprintf(stderr, "%s: invalid number of ticks\n", optarg);
+				return 1;
+			}
+			break;
+		case 'D':
+			mn::physics::Objects::deterministic = true;
+			break;
+		case 'd':
+			mn::physics::timeStep = atof(optarg);
+			if (!(mn::physics::timeStep > 0)) {
+				fprintf(stderr, "%s: invalid time step\n", optarg);
+				return 1;
+			}
+			break;
+		case 'S':
+			mn::physics::Simulation::snapshotFile = optarg;
+			break;
+		case 'E':
+			mn::physics::Simulation::snapshotInterval = strtoull(optarg, 0, 0);
+			if (!mn::physics::Simulation::snapshotInterval) {
+				fprintf(stderr, "%s: invalid number of ticks\n", optarg);
+				return 1;
+			}
+			break;
+		case 'e':
+			energyDriftTicks = optarg ? atoi(optarg) : 10000;
+			break;
+		case 'B':
+			benchmarkError = optarg ? atof(optarg) : 1e-6;
+			break;
+		case 'R':
+			precisionTicks = optarg ? atoi(optarg) : 100;
+			break;
+		case 'O':
+			fmmReport = true;
+			break;
 		case '?':
 			puts("usage: ./solar [ <options> ] [ <data-file> ]\n"
 				 "<options>:\n"
@@ -339,6 +533,59 @@ int main(int argc, char** argv) {
 				 " -1 --low            use low quality textures\n"
 				 " -2 --medium         use medium quality textures\n"
 				 " -3 --high           use high quality textures\n"
+				 " -b --barnes-hut[=<theta>]\n"
+				 "                     use Barnes-Hut octree with given opening\n"
+				 "                     angle (0.5 by default) to calculate forces\n"
+				 " -p --symmetric      calculate forces for each pair of objects once\n"
+				 " -f --fmm[=<order>]  use fast multipole method with expansions of\n"
+				 "                     given order, 1 to 8 (4 by default)\n"
+				 " -T --theta=<theta>  opening angle of Barnes-Hut and fast multipole\n"
+				 "                     method (0.5 by default); must be less then one\n"
+				 "                     for the latter\n"
+				 " -u --refit[=<tolerance>]\n"
+				 "                     refit tree to moved objects instead of building\n"
+				 "                     it again until it grows by given fraction\n"
+				 "                     (0.2 by default)\n"
+				 " -t --threads=<n>    number of threads calculating forces\n"
+				 "                     (number of CPUs by default)\n"
+				 " -s --simd[=<isa>]   use vectorised direct sum; <isa> is one of\n"
+				 "                     scalar, avx2, avx512 or auto (default)\n"
+				 " -r --rsqrt          use approximate reciprocal square root\n"
+				 "                     in vectorised direct sum\n"
+				 " -M --mixed          use vectorised direct sum calculating inverse\n"
+				 "                     distances in single precision\n"
+				 " -a --sum=<method>   method of summing accelerations in direct sum;\n"
+				 "                     sorted, neumaier (default) or pairwise\n"
+				 " -i --integrator=<name>\n"
+				 "                     euler (default), verlet, block or hermite\n"
+				 "                     (the last two calculate forces by direct sum)\n"
+				 " -C --collisions     merge objects which touch each other\n"
+				 " -F --frozen-field[=<cells>]\n"
+				 "                     cache field of frozen objects on a grid with\n"
+				 "                     given number of cells (64 by default)\n"
+				 " -z --morton[=<ticks>]\n"
+				 "                     sort objects by Morton code of their positions\n"
+				 "                     every given number of ticks (100 by default)\n"
+				 " -D --deterministic  make results independent of number of threads\n"
+				 " -d --dt=<dt>        length of a single tick (0.004 by default)\n"
+				 " -S --snapshot=<file>\n"
+				 "                     save snapshot of objects to given file on exit;\n"
+				 "                     snapshot can be given instead of data file\n"
+				 " -E --snapshot-every=<ticks>\n"
+				 "                     save snapshot every given number of ticks too\n"
+				 " -e --energy-drift[=<ticks>]\n"
+				 "                     print energy drift of each integrator after\n"
+				 "                     given number of ticks (10000 by default) and exit\n"
+				 " -B --benchmark[=<error>]\n"
+				 "                     print time each integrator needs to simulate\n"
+				 "                     10000 ticks worth of time with energy error\n"
+				 "                     below given value (1e-6 by default) and exit\n"
+				 " -R --precision-report[=<ticks>]\n"
+				 "                     compare double, mixed and float direct sum\n"
+				 "                     over given number of ticks (100 by default)\n"
+				 "                     and exit\n"
+				 " -O --fmm-report     print error and time of fast multipole method\n"
+				 "                     with each expansion order and exit\n"
 				 "  folowing can be toggled during runtime:\n"
 				 " -x --no-textures    do not use display textures\n"
 				 " -c --low-detail     use fewer vertices\n"
@@ -351,6 +598,26 @@ int main(int argc, char** argv) {
 		}
 	}
 
+	/* Expansions of nodes closer then that would not converge. */
+	if ((mn::physics::Objects::solver == mn::physics::Objects::FMM ||
+	     fmmReport) && !(mn::physics::Objects::theta < 1)) {
+		fprintf(stderr, "%g: opening angle of fast multipole method must "
+		        "be less then one\n", (double)mn::physics::Objects::theta);
+		return 1;
+	}
+
+	/* Block time steps calculate jerks along with forces by direct
+	 * summation of their own. */
+	if ((mn::physics::Objects::integrator == mn::physics::Objects::BLOCK ||
+	     mn::physics::Objects::integrator == mn::physics::Objects::HERMITE) &&
+	    (mn::physics::Objects::solver != mn::physics::Objects::DIRECT ||
+	     mn::physics::Objects::useKernel || mn::physics::Objects::fieldCells)) {
+		fprintf(stderr, "%s integrator calculates forces by direct sum; "
+		        "-b, -p, -f, -s, -M and -F cannot be used with it\n",
+		        mn::physics::integratorNames[mn::physics::Objects::integrator]);
+		return 1;
+	}
+
 	switch (quality) {
 	case -1:
 		mn::gl::Texture::useNearest = true;
@@ -379,10 +646,48 @@ int main(int argc, char** argv) {
 		if (!data) {
 			puts("Reading data from standard input");
 		}
-		mn::physics::objects = mn::physics::loadData(data);
+		unsigned long long ticks = 0;
+		if (data && mn::physics::Objects::isSnapshot(data)) {
+			double dt;
+			mn::physics::objects =
+				mn::physics::Objects::loadSnapshot(data, ticks, dt);
+			mn::physics::timeStep = dt;
+		} else {
+			mn::physics::objects = mn::physics::loadData(data);
+		}
 		if (!mn::physics::objects) {
 			return 1;
 		}
+
+		mn::physics::printSolver(*mn::physics::objects);
+		if (energyDriftTicks) {
+			mn::physics::printEnergyDrift(*mn::physics::objects,
+			                              energyDriftTicks,
+			                              mn::physics::timeStep);
+		}
+		if (benchmarkError > 0) {
+			mn::physics::printIntegratorBenchmark(*mn::physics::objects,
+			                                      10000 * mn::physics::timeStep,
+			                                      benchmarkError);
+		}
+		if (precisionTicks) {
+			mn::physics::printPrecisionReport(*mn::physics::objects,
+			                                  precisionTicks,
+			                                  mn::physics::timeStep);
+		}
+		if (fmmReport) {
+			mn::physics::printFmmReport(*mn::physics::objects);
+		}
+		if (energyDriftTicks || benchmarkError > 0 || precisionTicks ||
+		    fmmReport) {
+			return 0;
+		}
+
+		mn::physics::renderer =
+			new mn::physics::Renderer(*mn::physics::objects);
+		mn::physics::simulation =
+			new mn::physics::Simulation(*mn::physics::objects,
+			                            mn::physics::timeStep, ticks);
 	}
 
 
@@ -460,6 +765,9 @@ int main(int argc, char** argv) {
 	     "        j  head light    n  names         m  stars\n");
 
 
+	mn::physics::simulation->setSpeed(mn::gl::Camera::countTicks
+	                                  ? mn::gl::Camera::tickIncrement : 0);
+	mn::physics::simulation->start();
 	glutMainLoop();
 	return 0;
 }
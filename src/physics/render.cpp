@@ -0,0 +1,201 @@
+/*
+ * src/physics/render.cpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "render.hpp"
+
+#ifdef __APPLE__
+#  include <OpenGL/OpenGL.h>
+#  include <GLUT/glut.h>
+#else
+#  include <GL/glut.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+
+#include "../common/camera.hpp"
+#include "../common/text3d.hpp"
+#include "../common/sintable.hpp"
+#include "../common/quadric.hpp"
+#include "../common/mconst.h"
+
+
+namespace mn {
+
+namespace physics {
+
+
+Objects::value_type Renderer::cutoffDistance2 = 2500.0;
+bool Renderer::lowQuality = false;
+bool Renderer::drawNames = true;
+bool Renderer::useTextures = true;
+
+static const GLfloat materialSpecular[] = { 0.75, 0.75, 0.75, 1 };
+static const GLfloat zeros           [] = { 0, 0, 0, 1 };
+static const GLfloat ones            [] = { 1, 1, 1, 1 };
+
+
+namespace {
+struct PushMatrix {
+	PushMatrix() { glPushMatrix(); }
+	~PushMatrix() { glPopMatrix(); }
+};
+}
+
+
+Renderer::Renderer(const Objects &theObjects) : frame(0) {
+	unsigned count = 0;
+	for (unsigned i = 0, n = theObjects.size(); i < n; ++i) {
+		count = std::max(count, theObjects.getId(i) + 1);
+	}
+	objects.assign(count, Object(std::string()));
+	std::vector<Body>(count).swap(bodies);
+
+	for (unsigned i = 0, n = theObjects.size(); i < n; ++i) {
+		const unsigned id = theObjects.getId(i);
+		const Object &object = objects[id] = theObjects[i];
+		Body &body = bodies[id];
+		body.frame = 0;
+
+		gl::Color color = object.color;
+		if (!object.texture.empty()) {
+			body.texture.load(object.texture.c_str());
+			if (body.texture) {
+				color = body.texture.getAverageColor();
+			}
+		}
+
+		body.materialColor[0] = color.r;
+		body.materialColor[1] = color.g;
+		body.materialColor[2] = color.b;
+		body.materialColor[3] = 1;
+	}
+}
+
+
+void Renderer::drawAll(const std::vector<unsigned> &ids,
+                       const std::vector<Objects::Vector> &positions,
+                       const std::vector<Objects::value_type> &sizes) {
+	++frame;
+	for (unsigned i = 0, n = ids.size(); i < n; ++i) {
+		draw(ids[i], positions[i], sizes[i]);
+	}
+
+	for (unsigned id = 0, n = bodies.size(); id < n; ++id) {
+		if (objects[id].light >= 0 && bodies[id].frame != frame) {
+			glDisable(GL_LIGHT0 + objects[id].light);
+		}
+	}
+}
+
+
+void Renderer::drawTracers(const std::vector<gl::Vector<float> > &points) {
+	if (points.empty()) {
+		return;
+	}
+
+	glColor3f(0.6, 0.6, 0.6);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_FLOAT, sizeof points[0], &points[0]);
+	glDrawArrays(GL_POINTS, 0, points.size());
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+
+void Renderer::draw(unsigned id, const Objects::Vector &point,
+                    Objects::value_type size) {
+	Body &body = bodies[id];
+	const int light = objects[id].light;
+	body.frame = frame;
+
+	const gl::Camera *const cam = gl::Camera::camera;
+	const bool inFront = cam ? cam->isInFront(point) : true;
+
+	PushMatrix _p;
+
+	glTranslatef(point.x, point.y, point.z);
+
+	if (light >= 0) {
+		glEnable(GL_LIGHT0 + light);
+		glLightfv(GL_LIGHT0 + light, GL_DIFFUSE, ones);
+		glLightfv(GL_LIGHT0 + light, GL_POSITION, zeros);
+	}
+
+	if (!inFront) {
+		return;
+	}
+
+	const bool gotTexture = useTextures && *body.texture;
+	if (gotTexture) {
+		glEnable(GL_TEXTURE_2D);
+		gluQuadricTexture(gl::Quadric::quadric()->get(), 1);
+		glBindTexture(GL_TEXTURE_2D, *body.texture);
+		glPushMatrix();
+		glRotatef(90.0f, 1.0f, 0.0f, 0.0f);
+	}
+
+	glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE,
+	             gotTexture ? ones : body.materialColor);
+	glMaterialfv(GL_FRONT, GL_SPECULAR,
+	             light >= 0 ? zeros : materialSpecular);
+	glMaterialfv(GL_FRONT, GL_EMISSION,
+	             light <  0 ? zeros : (gotTexture ? ones : body.materialColor));
+	glMaterialf(GL_FRONT, GL_SHININESS, light >= 0 ? 0 : 12);
+
+	const Objects::value_type distance2 = cam ? cam->getEye().distance2(point) : 0;
+	const Objects::value_type distanceFactor2 = distance2 > cutoffDistance2 ? std::sqrt(distance2 / cutoffDistance2) : 1;
+	unsigned slices = 60 / distanceFactor2;
+	if (size > 1) slices *= 2;
+	if (lowQuality) slices /= 3;
+	if (slices < 6) slices = 6;
+	gluSphere(gl::Quadric::quadric()->get(), size, slices, slices);
+
+	if (gotTexture) {
+		gluQuadricTexture(gl::Quadric::quadric()->get(), 0);
+		glDisable(GL_TEXTURE_2D);
+		glPopMatrix();
+	}
+
+	if (!drawNames || distanceFactor2 >= 1.1f) {
+		return;
+	}
+
+	if (cam) {
+		glRotatef(cam->getRotY() * -MN_180_PI, 0, 1, 0);
+	}
+	/* Size changes when objects merge so it is not in the list. */
+	glTranslatef(0, size + 0.3f, 0);
+	if (!body.textList) {
+		body.textList = glGenLists(1);
+		if (body.textList) glNewList(body.textList, GL_COMPILE);
+		glScalef(0.1, 0.1, 0.1);
+		glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, body.materialColor);
+		glMaterialfv(GL_FRONT, GL_EMISSION, zeros);
+		t3d::draw3D(objects[id].name, 0, 0, 0.5);
+		if (body.textList) {
+			glEndList();
+			glCallList(body.textList);
+		}
+	} else {
+		glCallList(body.textList);
+	}
+}
+
+
+}
+
+}
@@ -0,0 +1,96 @@
+/*
+ * src/physics/render.hpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef H_RENDER_HPP
+#define H_RENDER_HPP
+
+#include <vector>
+
+#include "../common/texture.hpp"
+#include "object.hpp"
+
+
+namespace mn {
+
+namespace physics {
+
+
+/**
+ * Draws objects.  Keeps OpenGL resources (textures and display
+ * lists) and a copy of attributes of each object indexed by object's
+ * identifier (see BasicObjects::getId()) so that objects may be
+ * merged and removed by the simulation while they are drawn.
+ */
+struct Renderer {
+	/**
+	 * Creates renderer for given objects and loads their textures.
+	 * Color of an object which has a texture is set to texture's
+	 * average color.
+	 */
+	explicit Renderer(const Objects &theObjects);
+
+	/**
+	 * Draws object with given identifier at given point.  Positions
+	 * and sizes are passed explicitly since objects may be simulated
+	 * in another thread.
+	 */
+	void draw(unsigned id, const Objects::Vector &point,
+	          Objects::value_type size);
+	/**
+	 * Draws all objects and turns off lights of objects which are not
+	 * there any more.
+	 */
+	void drawAll(const std::vector<unsigned> &ids,
+	             const std::vector<Objects::Vector> &positions,
+	             const std::vector<Objects::value_type> &sizes);
+
+	/**
+	 * Draws tracers (see BasicObjects::addTracer()) as points.
+	 * Lighting must be turned off.
+	 */
+	static void drawTracers(const std::vector<gl::Vector<float> > &points);
+
+	/** Returns attributes of object with given identifier. */
+	const Object &getObject(unsigned id) const { return objects[id]; }
+
+	static Objects::value_type cutoffDistance2;
+	static bool lowQuality, drawNames, useTextures;
+
+private:
+	struct Body {
+		Body() : textList(0) { }
+
+		gl::Texture texture;
+		float materialColor[4];
+		unsigned textList;
+		/** Number of the last frame the object was drawn in. */
+		unsigned frame;
+	};
+
+	std::vector<Object> objects;
+	std::vector<Body> bodies;
+	unsigned frame;
+
+	Renderer(const Renderer &r) { (void)r; }
+};
+
+
+}
+
+}
+
+#endif
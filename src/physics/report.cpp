@@ -0,0 +1,400 @@
+/*
+ * src/physics/report.cpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "report.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <type_traits>
+
+#include "fmm.hpp"
+
+
+namespace mn {
+
+namespace physics {
+
+
+const char *const integratorNames[] = {
+	"euler", "verlet", "block", "hermite"
+};
+
+bool parseIntegrator(const char *str, ObjectsBase::Integrator &integrator) {
+	for (unsigned i = 0; i <= ObjectsBase::HERMITE; ++i) {
+		if (!strcmp(str, integratorNames[i])) {
+			integrator = (ObjectsBase::Integrator)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+template<class T>
+void printSolver(const BasicObjects<T> &) {
+	static const char *const summations[] = {
+		"sorted", "Neumaier", "pairwise"
+	};
+
+	if (ObjectsBase::solver == ObjectsBase::BARNES_HUT) {
+		printf("Using Barnes-Hut solver (theta = %.2f)\n",
+		       (double)ObjectsBase::theta);
+	} else if (ObjectsBase::solver == ObjectsBase::FMM) {
+		printf("Using fast multipole method (order %u, theta = %.2f)\n",
+		       ObjectsBase::fmmOrder, (double)ObjectsBase::theta);
+	} else if (ObjectsBase::solver == ObjectsBase::SYMMETRIC) {
+		puts("Using symmetric pair solver");
+	} else if (ObjectsBase::useKernel) {
+		printf("Using %s%s kernel%s\n", kernel::name(ObjectsBase::isa),
+		       ObjectsBase::mixed && std::is_same<T, double>::value
+		       ? " mixed precision" : "",
+		       ObjectsBase::rsqrt ? " with rsqrt" : "");
+	} else {
+		printf("Using %s summation\n", summations[ObjectsBase::summation]);
+	}
+
+	if (ObjectsBase::forceLaw != force::NEWTON ||
+	    ObjectsBase::softening != 0.1) {
+		printf("Using %s force law (softening = %g)\n",
+		       force::name(ObjectsBase::forceLaw), ObjectsBase::softening);
+	}
+
+	if (ObjectsBase::fieldCells) {
+		printf("Caching field of frozen objects on %u cell grid\n",
+		       ObjectsBase::fieldCells);
+	}
+
+	if (ObjectsBase::refitTolerance > 0 &&
+	    (ObjectsBase::solver == ObjectsBase::BARNES_HUT ||
+	     ObjectsBase::solver == ObjectsBase::FMM)) {
+		printf("Refitting tree until it grows by %g\n",
+		       ObjectsBase::refitTolerance);
+	}
+
+	if (ObjectsBase::sortInterval) {
+		printf("Sorting objects by Morton code every %u ticks\n",
+		       ObjectsBase::sortInterval);
+	}
+
+	if (ObjectsBase::deterministic) {
+		puts("Results do not depend on number of threads");
+	}
+
+}
+
+
+/**
+ * Simulates objects for given number of ticks checking total energy
+ * about a hundred times on the way.
+ * \return maximal relative change of total energy.
+ */
+template<class T>
+static T run(BasicObjects<T> &objects, unsigned ticks, T dt, T *drift = 0) {
+	const unsigned samples = 100;
+	const T initial = objects.energyAll();
+	T max = 0, current = 0;
+
+	for (unsigned done = 0; done < ticks; ) {
+		const unsigned count =
+			std::max(1u, std::min(ticks / samples, ticks - done));
+		objects.ticksAll(count, dt);
+		objects.updatePointAll();
+		done += count;
+
+		current = std::fabs((objects.energyAll() - initial) / initial);
+		max = std::max(max, current);
+	}
+
+	if (drift) {
+		*drift = current;
+	}
+	return max;
+}
+
+
+template<class T>
+void printEnergyDrift(const BasicObjects<T> &objects, unsigned ticks,
+                      typename BasicObjects<T>::value_type dt) {
+	const ObjectsBase::Integrator integrator = ObjectsBase::integrator;
+
+	printf("Energy drift after %u ticks of %g:\n", ticks, (double)dt);
+	for (unsigned i = 0; i <= ObjectsBase::HERMITE; ++i) {
+		ObjectsBase::integrator = (ObjectsBase::Integrator)i;
+		BasicObjects<T> copy(objects);
+
+		T drift;
+		const T max = run(copy, ticks, dt, &drift);
+		printf("  %-8s final = %g, max = %g, evaluations per tick = %.1f\n",
+		       integratorNames[i], (double)drift, (double)max,
+		       (double)copy.getEvaluations() / ticks);
+	}
+
+	ObjectsBase::integrator = integrator;
+}
+
+
+template<class T>
+void printIntegratorBenchmark(const BasicObjects<T> &objects,
+                              typename BasicObjects<T>::value_type duration,
+                              typename BasicObjects<T>::value_type maxError) {
+	/* Give up when a single run would need more ticks. */
+	const unsigned maxTicks = 1u << 20;
+	const ObjectsBase::Integrator integrator = ObjectsBase::integrator;
+
+	printf("Time needed to simulate unit of time with energy error "
+	       "below %g:\n", (double)maxError);
+	for (unsigned i = 0; i <= ObjectsBase::HERMITE; ++i) {
+		ObjectsBase::integrator = (ObjectsBase::Integrator)i;
+
+		unsigned ticks = 16;
+		for (; ticks <= maxTicks; ticks *= 2) {
+			BasicObjects<T> copy(objects);
+			const T dt = duration / ticks;
+
+			const std::chrono::steady_clock::time_point start =
+				std::chrono::steady_clock::now();
+			const T error = run(copy, ticks, dt);
+			const double seconds = std::chrono::duration<double>(
+				std::chrono::steady_clock::now() - start).count();
+
+			if (error <= maxError) {
+				printf("  %-8s dt = %-10g error = %-10g "
+				       "%g s per unit of time\n",
+				       integratorNames[i], (double)dt, (double)error,
+				       seconds / (double)duration);
+				break;
+			}
+		}
+
+		if (ticks > maxTicks) {
+			printf("  %-8s error not reached with dt = %g\n",
+			       integratorNames[i], (double)(duration / maxTicks));
+		}
+	}
+
+	ObjectsBase::integrator = integrator;
+}
+
+
+
+/**
+ * Copies objects converting them to other scalar type and moving
+ * them by given offset.
+ */
+template<class U, class T>
+static BasicObjects<U> *convert(const BasicObjects<T> &objects,
+                                const gl::Vector<T> &offset) {
+	BasicObjects<U> *const result = new BasicObjects<U>();
+	for (unsigned i = 0, n = objects.size(); i < n; ++i) {
+		const unsigned k = result->add(objects.getName(i));
+		(*result)[k] = objects[i];
+		result->setPosition(k, objects.getPosition(i) + offset);
+		result->setVelocity(k, objects.getVelocity(i));
+		result->setMass(k, objects.getMass(i));
+		result->setSize(k, objects.getSize(i));
+		result->setFrozen(k, objects.isFrozen(i));
+	}
+	return result;
+}
+
+/**
+ * Simulates objects and returns largest distance between their final
+ * positions and given reference positions moved by offset.
+ */
+template<class T>
+static double deviation(BasicObjects<T> &objects, unsigned ticks,
+                        double dt, const BasicObjects<double> &reference,
+                        const gl::Vector<double> &offset, double &seconds) {
+	const std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+	objects.ticksAll(ticks, dt);
+	objects.updatePointAll();
+	seconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+
+	double max = 0;
+	for (unsigned i = 0, n = objects.size(); i < n; ++i) {
+		const gl::Vector<double> p = objects.getPosition(i);
+		max = std::max(max, (p - offset).distance(reference.getPosition(i)));
+	}
+	return max;
+}
+
+
+static void precisionReport(const BasicObjects<double> &objects,
+                            unsigned ticks, double dt) {
+	const bool useKernel = ObjectsBase::useKernel, mixed = ObjectsBase::mixed;
+	const ObjectsBase::Solver solver = ObjectsBase::solver;
+	ObjectsBase::useKernel = true;
+	ObjectsBase::solver = ObjectsBase::DIRECT;
+
+	double max, rms;
+	ObjectsBase::mixed = false;
+	objects.solverErrorAll(max, rms);
+	printf("Acceleration error against sorted sum:\n"
+	       "  double   max = %-10g rms = %g\n", max, rms);
+	ObjectsBase::mixed = true;
+	objects.solverErrorAll(max, rms);
+	printf("  mixed    max = %-10g rms = %g\n", max, rms);
+
+	/* Distance of the scene from the origin, in multiples of its
+	 * size, which makes pure float positions lose precision. */
+	static const double far = 1e4;
+	double size = 0;
+	for (unsigned i = 0, n = objects.size(); i < n; ++i) {
+		size = std::max(size, objects.getPosition(i).length());
+	}
+
+	ObjectsBase::mixed = false;
+	BasicObjects<double> reference(objects);
+	double seconds;
+	deviation(reference, ticks, dt, objects, gl::Vector<double>(), seconds);
+	printf("Largest distance from double precision positions after "
+	       "%u ticks of %g:\n"
+	       "  double     %-12s %.3g s per tick\n",
+	       ticks, dt, "-", seconds / ticks);
+
+	for (unsigned k = 0; k < 2; ++k) {
+		const char *const where = k ? "far" : "";
+		const gl::Vector<double> offset =
+			k ? gl::Vector<double>(far * size, 0, 0) : gl::Vector<double>();
+
+		if (k) {
+			ObjectsBase::mixed = false;
+			BasicObjects<double> *const moved =
+				convert<double>(objects, offset);
+			const double error = deviation(*moved, ticks, dt, reference,
+			                               offset, seconds);
+			printf("  double %-3s %-12g %.3g s per tick\n",
+			       where, error, seconds / ticks);
+			delete moved;
+		}
+
+		ObjectsBase::mixed = true;
+		BasicObjects<double> *const moved = convert<double>(objects, offset);
+		double error = deviation(*moved, ticks, dt, reference,
+		                         offset, seconds);
+		printf("  mixed  %-3s %-12g %.3g s per tick\n",
+		       where, error, seconds / ticks);
+		delete moved;
+
+		BasicObjects<float> *const single = convert<float>(objects, offset);
+		error = deviation(*single, ticks, dt, reference, offset, seconds);
+		printf("  float  %-3s %-12g %.3g s per tick\n",
+		       where, error, seconds / ticks);
+		delete single;
+	}
+	printf("(\"far\" means scene moved %g times its size from the "
+	       "origin)\n", far);
+
+	ObjectsBase::useKernel = useKernel;
+	ObjectsBase::mixed = mixed;
+	ObjectsBase::solver = solver;
+}
+
+/** Converts objects to double and calls the above. */
+template<class T>
+static void precisionReport(const BasicObjects<T> &objects, unsigned ticks,
+                            double dt) {
+	const BasicObjects<double> *const copy =
+		convert<double>(objects, gl::Vector<T>());
+	precisionReport(*copy, ticks, dt);
+	delete copy;
+}
+
+template<class T>
+void printPrecisionReport(const BasicObjects<T> &objects, unsigned ticks,
+                          double dt) {
+	/* Double objects are taken as they are by the overload above. */
+	precisionReport(objects, ticks, dt);
+}
+
+
+/** Returns wall time of calculating accelerations of all objects. */
+template<class T>
+static double accelerationsTime(const BasicObjects<T> &objects) {
+	const ObjectsBase::Integrator integrator = ObjectsBase::integrator;
+	ObjectsBase::integrator = ObjectsBase::EULER;
+	BasicObjects<T> copy(objects);
+
+	const std::chrono::steady_clock::time_point start =
+		std::chrono::steady_clock::now();
+	copy.tickAll(0);
+	const double seconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+
+	ObjectsBase::integrator = integrator;
+	return seconds;
+}
+
+template<class T>
+void printFmmReport(const BasicObjects<T> &objects) {
+	const ObjectsBase::Solver solver = ObjectsBase::solver;
+	const unsigned order = ObjectsBase::fmmOrder;
+	const bool useKernel = ObjectsBase::useKernel;
+	const kernel::Isa isa = ObjectsBase::isa;
+
+	printf("FMM error against sorted sum for %u objects "
+	       "(theta = %.2f):\n", objects.size(), (double)ObjectsBase::theta);
+	ObjectsBase::solver = ObjectsBase::FMM;
+	for (unsigned p = 1; p <= Fmm<T>::maxOrder; ++p) {
+		ObjectsBase::fmmOrder = p;
+		T max, rms;
+		objects.solverErrorAll(max, rms);
+		printf("  order %u  max = %-12g rms = %-12g %.3g s\n", p,
+		       (double)max, (double)rms, accelerationsTime(objects));
+	}
+
+	if (!useKernel) {
+		kernel::parse("auto", ObjectsBase::isa);
+		ObjectsBase::useKernel = true;
+	}
+	ObjectsBase::solver = ObjectsBase::DIRECT;
+	printf("  %s direct sum %.3g s\n", kernel::name(ObjectsBase::isa),
+	       accelerationsTime(objects));
+
+	ObjectsBase::solver = solver;
+	ObjectsBase::fmmOrder = order;
+	ObjectsBase::useKernel = useKernel;
+	ObjectsBase::isa = isa;
+}
+
+
+#define INSTANTIATE(T) \
+	template void printSolver(const BasicObjects<T> &objects); \
+	template void printEnergyDrift(const BasicObjects<T> &objects, \
+	                               unsigned ticks, T dt); \
+	template void printIntegratorBenchmark(const BasicObjects<T> &objects, \
+	                                       T duration, T maxError); \
+	template void printPrecisionReport(const BasicObjects<T> &objects, \
+	                                   unsigned ticks, double dt); \
+	template void printFmmReport(const BasicObjects<T> &objects)
+
+INSTANTIATE(float);
+INSTANTIATE(double);
+INSTANTIATE(long double);
+
+#undef INSTANTIATE
+
+
+}
+
+}
@@ -0,0 +1,105 @@
+/*
+ * src/physics/report.hpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef H_REPORT_HPP
+#define H_REPORT_HPP
+
+#include "object.hpp"
+
+
+namespace mn {
+
+namespace physics {
+
+
+/** Names of integrators indexed by ObjectsBase::Integrator. */
+extern const char *const integratorNames[];
+
+/**
+ * Parses integrator's name.
+ * \param str integrator's name.
+ * \param integrator location to save result to.
+ * \return whether name was recognised.
+ */
+bool parseIntegrator(const char *str, ObjectsBase::Integrator &integrator);
+
+
+/**
+ * Prints configured solver.  Objects are used only to select the
+ * precision.
+ */
+template<class T>
+void printSolver(const BasicObjects<T> &objects);
+
+/**
+ * Runs simulation of a copy of objects with each integrator and
+ * prints relative change of total energy.
+ *
+ * \param objects objects to simulate.
+ * \param ticks number of ticks to run.
+ * \param dt length of a tick.
+ */
+template<class T>
+void printEnergyDrift(const BasicObjects<T> &objects, unsigned ticks,
+                      typename BasicObjects<T>::value_type dt);
+
+/**
+ * For each integrator looks for the longest tick, duration divided
+ * by a power of two, for which relative energy error does not exceed
+ * \a maxError and prints wall time it takes to simulate unit of
+ * time with it.
+ *
+ * \param objects objects to simulate.
+ * \param duration simulated time.
+ * \param maxError maximal accepted relative change of total energy.
+ */
+template<class T>
+void printIntegratorBenchmark(const BasicObjects<T> &objects,
+                              typename BasicObjects<T>::value_type duration,
+                              typename BasicObjects<T>::value_type maxError);
+
+/**
+ * Compares direct sum calculated by the kernel in double precision
+ * with mixed precision kernel and with float objects.  Objects are
+ * converted to double first if needed.  Prints error
+ * of accelerations and distance between positions after simulating
+ * given number of ticks, for objects as given and moved far away
+ * from the origin.
+ *
+ * \param objects objects to simulate.
+ * \param ticks number of ticks to run.
+ * \param dt length of a tick.
+ */
+template<class T>
+void printPrecisionReport(const BasicObjects<T> &objects, unsigned ticks,
+                          double dt);
+
+/**
+ * For each expansion order of FMM solver prints error of
+ * accelerations against sorted sum and time it takes to calculate
+ * them, followed by time the vectorised direct sum takes.  Uses
+ * configured opening angle.
+ */
+template<class T>
+void printFmmReport(const BasicObjects<T> &objects);
+
+
+}
+
+}
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * src/physics/simulation.cpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "simulation.hpp"
+
+#include <chrono>
+
+
+namespace mn {
+
+namespace physics {
+
+
+unsigned Simulation::period = 40;
+const char *Simulation::snapshotFile = 0;
+unsigned long long Simulation::snapshotInterval = 0;
+
+
+Simulation::Simulation(Objects &theObjects, Objects::value_type theDt,
+                       unsigned long long theTicks)
+	: objects(theObjects), dt(theDt), ticks(theTicks), running(false),
+	  speed(0) {
+	publish();
+}
+
+
+void Simulation::start() {
+	if (!running.exchange(true)) {
+		thread = std::thread(&Simulation::run, this);
+	}
+}
+
+
+void Simulation::stop() {
+	running.store(false);
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+
+void Simulation::run() {
+	typedef std::chrono::steady_clock clock;
+	const clock::duration step = std::chrono::milliseconds(period);
+	clock::time_point next = clock::now();
+
+	while (running.load(std::memory_order_relaxed)) {
+		const unsigned count = speed.load(std::memory_order_relaxed);
+		if (count) {
+			objects.ticksAll(count, dt);
+			objects.updatePointAll();
+			ticks += count;
+			publish();
+			if (snapshotFile && snapshotInterval &&
+			    ticks / snapshotInterval !=
+			    (ticks - count) / snapshotInterval) {
+				saveSnapshot();
+			}
+		}
+
+		/* Do not try to catch up if simulation is slower then real
+		 * time; just carry on as fast as possible. */
+		next += step;
+		const clock::time_point now = clock::now();
+		if (next < now) {
+			next = now;
+		} else {
+			std::this_thread::sleep_until(next);
+		}
+	}
+}
+
+
+void Simulation::publish() {
+	State &state = buffer.writeBuffer();
+	const unsigned n = objects.size();
+	state.positions.resize(n);
+	state.velocities.resize(n);
+	state.sizes.resize(n);
+	state.ids.resize(n);
+	for (unsigned i = 0; i < n; ++i) {
+		state.positions[i] = objects.getPosition(i);
+		state.velocities[i] = objects.getVelocity(i);
+		state.sizes[i] = objects.getSize(i);
+		state.ids[i] = objects.getId(i);
+	}
+
+	const unsigned m = objects.tracers();
+	state.tracers.resize(m);
+	for (unsigned k = 0; k < m; ++k) {
+		state.tracers[k] = objects.getTracerPosition(k);
+	}
+	state.ticks = ticks;
+	buffer.publish();
+}
+
+
+}
+
+}
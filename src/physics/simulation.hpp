@@ -0,0 +1,140 @@
+/*
+ * src/physics/simulation.hpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef H_SIMULATION_HPP
+#define H_SIMULATION_HPP
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "object.hpp"
+#include "triple-buffer.hpp"
+
+
+namespace mn {
+
+namespace physics {
+
+
+/**
+ * Runs simulation of objects in a separate thread.  After each step
+ * positions and velocities of objects are published through a triple
+ * buffer so that they can be read (e.g. to draw a frame) without
+ * waiting for the simulation nor stopping it.
+ *
+ * While the thread is running objects must not be modified nor their
+ * positions or velocities read by anyone else.
+ */
+struct Simulation {
+	/** State of objects published after each step. */
+	struct State {
+		std::vector<Objects::Vector> positions, velocities;
+		std::vector<Objects::value_type> sizes;
+		/**
+		 * Identifiers of objects (see BasicObjects::getId()).  They
+		 * differ from indexes once objects start merging.
+		 */
+		std::vector<unsigned> ids;
+		/**
+		 * Positions of tracers (see BasicObjects::addTracer()) in
+		 * single precision which is enough to draw them.
+		 */
+		std::vector<gl::Vector<float> > tracers;
+		/** Number of ticks simulated so far. */
+		unsigned long long ticks;
+	};
+
+	/**
+	 * Creates simulation and publishes initial state of objects.
+	 * Thread is not started.
+	 * \param theObjects objects to simulate.
+	 * \param theDt length of a single tick.
+	 * \param theTicks number of ticks simulated before, e.g. when
+	 *        objects were loaded from a snapshot.
+	 */
+	Simulation(Objects &theObjects, Objects::value_type theDt,
+	           unsigned long long theTicks = 0);
+	/** Stops the thread. */
+	~Simulation() { stop(); }
+
+	void start();
+	/** Stops the thread and waits for it to finish current step. */
+	void stop();
+
+	/**
+	 * Sets number of ticks simulated in each step; zero pauses the
+	 * simulation.  May be called from any thread.
+	 */
+	void setSpeed(unsigned ticks) {
+		speed.store(ticks, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Returns the latest published state.  Must be called from
+	 * a single thread; reference stays valid until the next call.
+	 */
+	const State &state() { return buffer.read(); }
+
+	/**
+	 * Minimal duration of a step in milliseconds.  If step takes less
+	 * time, thread sleeps until the period ends.
+	 */
+	static unsigned period;
+
+	/**
+	 * File snapshots are saved to (see BasicObjects::saveSnapshot())
+	 * or NULL if none are saved.
+	 */
+	static const char *snapshotFile;
+	/**
+	 * If not zero, snapshot is saved by the thread every given number
+	 * of ticks (or after the first step which passes the multiple).
+	 */
+	static unsigned long long snapshotInterval;
+
+	/**
+	 * Saves snapshot of objects in #snapshotFile.  Must not be called
+	 * while the thread is running.
+	 */
+	bool saveSnapshot() const {
+		return objects.saveSnapshot(snapshotFile, ticks, dt);
+	}
+
+private:
+	Objects &objects;
+	const Objects::value_type dt;
+	unsigned long long ticks;
+
+	std::thread thread;
+	std::atomic<bool> running;
+	std::atomic<unsigned> speed;
+	TripleBuffer<State> buffer;
+
+	void run();
+	void publish();
+
+	Simulation(const Simulation &s) : objects(s.objects), dt(s.dt) { }
+	void operator=(const Simulation &s) { (void)s; }
+};
+
+
+}
+
+}
+
+#endif
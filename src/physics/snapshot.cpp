@@ -0,0 +1,380 @@
+/*
+ * src/physics/snapshot.cpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "object.hpp"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+
+namespace mn {
+
+namespace physics {
+
+
+namespace {
+
+/**
+ * Header of a snapshot file.  Numbers are in byte order of the
+ * machine which wrote the file; #order tells which one it was.
+ * Arrays hold only significant bytes of each value (see
+ * valueBytes()).  Header is followed by:
+ * - x, y, z, vx, vy, vz, mass and size of each object,
+ * - whether each object is frozen (one byte each),
+ * - identifier and light number of each object (32-bit integers),
+ * - colour of each object (three floats),
+ * - x, y, z, vx, vy and vz of each tracer,
+ * - name and texture of each object, each terminated by NUL.
+ */
+struct Header {
+	char magic[8];
+	uint32_t order, version;
+	/** Size and number of mantissa digits of the scalar type. */
+	uint32_t scalarSize, scalarDigits;
+	uint32_t count, tracers, nextId, law;
+	uint64_t ticks;
+	double dt, softening;
+	/** Size of the whole file. */
+	uint64_t size;
+};
+
+const char magic[8] = { 'M', 'N', 'P', 'H', 'Y', 'S', 'S', 'N' };
+const uint32_t order = 0x01020304;
+const uint32_t version = 1;
+
+
+/**
+ * Returns number of significant bytes of type V.  x87 extended
+ * precision values have 10 but are padded to 12 or 16 bytes with
+ * garbage which is not written.
+ */
+template<class V>
+unsigned valueBytes() {
+	return std::is_floating_point<V>::value &&
+		std::numeric_limits<V>::digits == 64 ? 10 : sizeof(V);
+}
+
+
+/** Reverses bytes of each of count elements of given size. */
+void swapBytes(void *data, unsigned size, size_t count) {
+	char *ptr = (char *)data;
+	for (; count; --count, ptr += size) {
+		std::reverse(ptr, ptr + size);
+	}
+}
+
+
+template<class V>
+void append(std::vector<char> &data, const std::vector<V> &v) {
+	const unsigned bytes = valueBytes<V>();
+	const char *const ptr = (const char *)v.data();
+	if (bytes == sizeof(V)) {
+		data.insert(data.end(), ptr, ptr + v.size() * sizeof(V));
+		return;
+	}
+	for (size_t i = 0; i < v.size(); ++i) {
+		data.insert(data.end(), ptr + i * sizeof(V),
+		            ptr + i * sizeof(V) + bytes);
+	}
+}
+
+void append(std::vector<char> &data, const std::string &str) {
+	data.insert(data.end(), str.c_str(), str.c_str() + str.size() + 1);
+}
+
+
+/** Reads consecutive arrays and strings of a snapshot. */
+struct Reader {
+	Reader(const std::vector<char> &theData, bool theSwap)
+		: data(theData), offset(sizeof(Header)), swap(theSwap) { }
+
+	template<class V>
+	bool read(std::vector<V> &v, unsigned count) {
+		const unsigned size = valueBytes<V>();
+		const size_t bytes = (size_t)count * size;
+		if (data.size() - offset < bytes) {
+			return false;
+		}
+		if (size == sizeof(V)) {
+			v.resize(count);
+			if (bytes) {
+				memcpy(v.data(), &data[offset], bytes);
+			}
+		} else {
+			/* Padding is not saved; leave zeros rather than garbage. */
+			v.resize(count);
+			memset((void *)v.data(), 0, count * sizeof(V));
+			for (unsigned i = 0; i < count; ++i) {
+				memcpy(&v[i], &data[offset + (size_t)i * size], size);
+			}
+		}
+		offset += bytes;
+		if (swap) {
+			swapBytes(v.data(), sizeof(V), count);
+		}
+		return true;
+	}
+
+	bool read(std::string &str) {
+		const char *const begin = data.data() + offset;
+		const char *const end =
+			(const char *)memchr(begin, 0, data.size() - offset);
+		if (!end) {
+			return false;
+		}
+		str.assign(begin, end);
+		offset += end - begin + 1;
+		return true;
+	}
+
+private:
+	const std::vector<char> &data;
+	size_t offset;
+	bool swap;
+};
+
+
+void swapHeader(Header &header) {
+	swapBytes(&header.order, 4, 8);
+	swapBytes(&header.ticks, 8, 4);
+}
+
+}
+
+
+bool ObjectsBase::isSnapshot(const char *filename) {
+	FILE *const fp = fopen(filename, "rb");
+	if (!fp) {
+		return false;
+	}
+	char buffer[sizeof magic];
+	const bool ret = fread(buffer, 1, sizeof buffer, fp) == sizeof buffer &&
+		!memcmp(buffer, magic, sizeof magic);
+	fclose(fp);
+	return ret;
+}
+
+
+template<class T>
+bool BasicObjects<T>::saveSnapshot(const char *filename,
+                                   unsigned long long ticks,
+                                   double dt) const {
+	const unsigned n = size();
+
+	Header header;
+	memset(&header, 0, sizeof header);
+	memcpy(header.magic, magic, sizeof magic);
+	header.order = order;
+	header.version = version;
+	header.scalarSize = valueBytes<T>();
+	header.scalarDigits = std::numeric_limits<T>::digits;
+	header.count = n;
+	header.tracers = tracers();
+	header.nextId = nextId;
+	header.law = forceLaw;
+	header.ticks = ticks;
+	header.dt = dt;
+	header.softening = softening;
+
+	std::vector<char> data(sizeof header);
+	append(data, x); append(data, y); append(data, z);
+	append(data, vx); append(data, vy); append(data, vz);
+	append(data, mass);
+	append(data, sizes);
+	append(data, frozen);
+	append(data, ids);
+
+	std::vector<int32_t> lights(n);
+	std::vector<float> colors(3 * n);
+	for (unsigned i = 0; i < n; ++i) {
+		lights[i] = objects[i].light;
+		colors[3 * i] = objects[i].color.r;
+		colors[3 * i + 1] = objects[i].color.g;
+		colors[3 * i + 2] = objects[i].color.b;
+	}
+	append(data, lights);
+	append(data, colors);
+
+	append(data, tracerX); append(data, tracerY); append(data, tracerZ);
+	append(data, tracerVX); append(data, tracerVY); append(data, tracerVZ);
+
+	for (unsigned i = 0; i < n; ++i) {
+		append(data, objects[i].name);
+		append(data, objects[i].texture);
+	}
+
+	header.size = data.size();
+	memcpy(&data[0], &header, sizeof header);
+
+	const std::string temporary = std::string(filename) + ".tmp";
+	FILE *const fp = fopen(temporary.c_str(), "wb");
+	if (!fp) {
+		perror(temporary.c_str());
+		return false;
+	}
+	const bool written = fwrite(&data[0], 1, data.size(), fp) == data.size();
+	if (fclose(fp) || !written) {
+		perror(temporary.c_str());
+		remove(temporary.c_str());
+		return false;
+	}
+	if (rename(temporary.c_str(), filename)) {
+		perror(filename);
+		remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+
+template<class T>
+BasicObjects<T> *BasicObjects<T>::loadSnapshot(const char *filename,
+                                               unsigned long long &ticks,
+                                               double &dt) {
+	std::vector<char> data;
+	{
+		FILE *const fp = fopen(filename, "rb");
+		if (!fp) {
+			perror(filename);
+			return 0;
+		}
+		long length = -1;
+		if (!fseek(fp, 0, SEEK_END)) {
+			length = ftell(fp);
+			rewind(fp);
+		}
+		if (length >= 0) {
+			data.resize(length);
+		}
+		const bool read = length >= 0 && (!length ||
+			fread(&data[0], 1, length, fp) == (size_t)length);
+		fclose(fp);
+		if (!read) {
+			fprintf(stderr, "%s: could not read\n", filename);
+			return 0;
+		}
+	}
+
+	Header header;
+	if (data.size() < sizeof header ||
+	    memcmp(&data[0], magic, sizeof magic)) {
+		fprintf(stderr, "%s: not a snapshot\n", filename);
+		return 0;
+	}
+	memcpy(&header, &data[0], sizeof header);
+
+	const bool swap = header.order != order;
+	if (swap) {
+		swapHeader(header);
+	}
+	if (header.order != order || header.version != version) {
+		fprintf(stderr, "%s: unsupported snapshot version\n", filename);
+		return 0;
+	}
+	/* Layout of long double differs between machines too much to
+	 * convert it by reversing bytes. */
+	if (swap && std::is_same<T, long double>::value) {
+		fprintf(stderr, "%s: long double snapshot saved on a machine with "
+		        "different byte order\n", filename);
+		return 0;
+	}
+	if (header.scalarSize != valueBytes<T>() ||
+	    header.scalarDigits != (uint32_t)std::numeric_limits<T>::digits) {
+		fprintf(stderr, "%s: snapshot saved with different precision\n",
+		        filename);
+		return 0;
+	}
+	if (header.size != data.size() || header.law > force::CUTOFF) {
+		fprintf(stderr, "%s: snapshot is corrupted\n", filename);
+		return 0;
+	}
+
+	const unsigned n = header.count, m = header.tracers;
+	BasicObjects *const objects = new BasicObjects();
+	Reader in(data, swap);
+	std::vector<int32_t> lights;
+	std::vector<float> colors;
+	bool ok =
+		in.read(objects->x, n) && in.read(objects->y, n) &&
+		in.read(objects->z, n) && in.read(objects->vx, n) &&
+		in.read(objects->vy, n) && in.read(objects->vz, n) &&
+		in.read(objects->mass, n) && in.read(objects->sizes, n) &&
+		in.read(objects->frozen, n) && in.read(objects->ids, n) &&
+		in.read(lights, n) && in.read(colors, 3 * n) &&
+		in.read(objects->tracerX, m) && in.read(objects->tracerY, m) &&
+		in.read(objects->tracerZ, m) && in.read(objects->tracerVX, m) &&
+		in.read(objects->tracerVY, m) && in.read(objects->tracerVZ, m);
+
+	objects->objects.reserve(n);
+	for (unsigned i = 0; ok && i < n; ++i) {
+		std::string name, texture;
+		ok = in.read(name) && in.read(texture);
+		Object object(name);
+		object.light = lights[i];
+		object.color = gl::color(colors[3 * i], colors[3 * i + 1],
+		                         colors[3 * i + 2]);
+		object.texture = texture;
+		objects->objects.push_back(object);
+	}
+
+	if (!ok) {
+		fprintf(stderr, "%s: snapshot is corrupted\n", filename);
+		delete objects;
+		return 0;
+	}
+
+	objects->nextX = objects->x;
+	objects->nextY = objects->y;
+	objects->nextZ = objects->z;
+	objects->tracerAX.assign(m, 0);
+	objects->tracerAY.assign(m, 0);
+	objects->tracerAZ.assign(m, 0);
+	objects->nextId = header.nextId;
+
+	forceLaw = (force::Law)header.law;
+	softening = header.softening;
+	ticks = header.ticks;
+	dt = header.dt;
+	return objects;
+}
+
+
+/* Rest of BasicObjects is instantiated in object.cpp. */
+template bool BasicObjects<float>::saveSnapshot(
+	const char *filename, unsigned long long ticks, double dt) const;
+template bool BasicObjects<double>::saveSnapshot(
+	const char *filename, unsigned long long ticks, double dt) const;
+template bool BasicObjects<long double>::saveSnapshot(
+	const char *filename, unsigned long long ticks, double dt) const;
+template BasicObjects<float> *BasicObjects<float>::loadSnapshot(
+	const char *filename, unsigned long long &ticks, double &dt);
+template BasicObjects<double> *BasicObjects<double>::loadSnapshot(
+	const char *filename, unsigned long long &ticks, double &dt);
+template BasicObjects<long double> *BasicObjects<long double>::loadSnapshot(
+	const char *filename, unsigned long long &ticks, double &dt);
+
+
+}
+
+}
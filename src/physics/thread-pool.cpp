@@ -0,0 +1,220 @@
+/*
+ * src/physics/thread-pool.cpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "thread-pool.hpp"
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+
+
+namespace mn {
+
+namespace physics {
+
+
+unsigned ThreadPool::threads = 0;
+ThreadPool *ThreadPool::singleton = 0;
+
+
+bool ThreadPool::parseThreads(const char *str, unsigned &count) {
+	char *end;
+	errno = 0;
+	const unsigned long value = strtoul(str, &end, 10);
+	/* strtoul() negates "-1" into a huge number which is rejected. */
+	if (errno || end == str || *end || value > maxThreads) {
+		return false;
+	}
+	count = value;
+	return true;
+}
+
+
+ThreadPool::ThreadPool(unsigned threadsCount)
+	: body(0), busy(0), grain(1), remaining(0), generation(0),
+	  stop(false) {
+	if (!threadsCount) {
+		threadsCount = std::thread::hardware_concurrency();
+	}
+	if (!threadsCount) {
+		threadsCount = 1;
+	}
+	queues.reset(new Queue[threadsCount]);
+	resetStats();
+	for (unsigned i = 1; i < threadsCount; ++i) {
+		workers.push_back(std::thread(&ThreadPool::work, this, i));
+	}
+}
+
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	wake.notify_all();
+	for (unsigned i = 0; i < workers.size(); ++i) {
+		workers[i].join();
+	}
+}
+
+
+void ThreadPool::resetStats() {
+	stats.runs = stats.steals = 0;
+	stats.longest = stats.average = 0;
+}
+
+
+bool ThreadPool::take(unsigned index, Range &range) {
+	{
+		Queue &own = queues[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.ranges.empty()) {
+			range = own.ranges.back();
+			own.ranges.pop_back();
+			return true;
+		}
+	}
+
+	/* Ranges at the front of a deque were pushed first so they are
+	 * the biggest ones. */
+	const unsigned n = size();
+	while (remaining) {
+		for (unsigned k = 1; k < n; ++k) {
+			Queue &victim = queues[(index + k) % n];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.ranges.empty()) {
+				range = victim.ranges.front();
+				victim.ranges.pop_front();
+				++queues[index].steals;
+				return true;
+			}
+		}
+		/* Nothing to steal but other threads are still working on
+		 * pieces they may split. */
+		std::this_thread::yield();
+	}
+	return false;
+}
+
+
+void ThreadPool::process(unsigned index) {
+	typedef std::chrono::steady_clock clock;
+
+	Queue &own = queues[index];
+	Range range;
+	while (take(index, range)) {
+		while (range.end - range.begin > grain) {
+			const Range upper = {
+				range.begin + (range.end - range.begin) / 2, range.end
+			};
+			{
+				std::lock_guard<std::mutex> lock(own.mutex);
+				own.ranges.push_back(upper);
+			}
+			range.end = upper.begin;
+		}
+
+		const clock::time_point start = clock::now();
+		(*body)(range.begin, range.end);
+		own.seconds +=
+			std::chrono::duration<double>(clock::now() - start).count();
+		remaining -= range.end - range.begin;
+	}
+}
+
+
+void ThreadPool::run(unsigned count, const Body &theBody) {
+	if (workers.empty()) {
+		if (count) theBody(0, count);
+		return;
+	}
+	if (!count) {
+		return;
+	}
+
+	const unsigned n = size();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		body = &theBody;
+		grain = std::max(count / (16 * n), 1u);
+		for (unsigned i = 0; i < n; ++i) {
+			const unsigned begin = (unsigned long long)count * i / n;
+			const unsigned end = (unsigned long long)count * (i + 1) / n;
+			queues[i].ranges.clear();
+			if (begin < end) {
+				const Range range = { begin, end };
+				queues[i].ranges.push_back(range);
+			}
+			queues[i].seconds = 0;
+			queues[i].steals = 0;
+		}
+		remaining = count;
+		busy = workers.size();
+		++generation;
+	}
+	wake.notify_all();
+
+	process(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (busy) {
+		done.wait(lock);
+	}
+	body = 0;
+
+	double longest = 0, sum = 0;
+	for (unsigned i = 0; i < n; ++i) {
+		longest = std::max(longest, queues[i].seconds);
+		sum += queues[i].seconds;
+		stats.steals += queues[i].steals;
+	}
+	++stats.runs;
+	stats.longest += longest;
+	stats.average += sum / n;
+}
+
+
+void ThreadPool::work(unsigned index) {
+	unsigned long seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!stop && generation == seen) {
+				wake.wait(lock);
+			}
+			if (stop) {
+				return;
+			}
+			seen = generation;
+		}
+
+		process(index);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!--busy) {
+			done.notify_one();
+		}
+	}
+}
+
+
+}
+
+}
@@ -0,0 +1,173 @@
+/*
+ * src/physics/thread-pool.hpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef H_THREAD_POOL_HPP
+#define H_THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace mn {
+
+namespace physics {
+
+
+/**
+ * A pool of worker threads running loops in parallel.  Calling
+ * thread takes part in the work as well so a pool with a single
+ * thread runs everything serially without any synchronisation.
+ *
+ * Work is balanced by stealing: each thread has a deque of ranges it
+ * is yet to process and threads which run out of work take ranges
+ * from deques of other threads.
+ */
+struct ThreadPool {
+	/** Function processing elements from range [begin, end). */
+	typedef std::function<void(unsigned begin, unsigned end)> Body;
+
+	/**
+	 * Starts threads.
+	 * \param count number of threads (including the calling one); if
+	 *        zero, number of hardware threads is used.
+	 */
+	explicit ThreadPool(unsigned count = 0);
+	/** Stops and joins all threads. */
+	~ThreadPool();
+
+	unsigned size() const { return workers.size() + 1; }
+
+	/**
+	 * Calls \a body for pieces of range [0, count) from all threads
+	 * and waits for all of them to finish.  Each thread starts with
+	 * a continuous size()-th part of the range which it splits in
+	 * halves, pushing upper halves on its deque, until the piece is
+	 * small enough to process.  A thread whose deque is empty steals
+	 * the biggest piece from the front of another thread's deque so
+	 * elements which take longer than others (like tree walks in
+	 * dense regions) do not leave threads idle.
+	 */
+	void run(unsigned count, const Body &body);
+
+	/** Statistics of jobs run by the pool. */
+	struct Stats {
+		/** Number of jobs run by more than one thread. */
+		unsigned long long runs;
+		/** Number of ranges taken from other threads' deques. */
+		unsigned long long steals;
+		/**
+		 * Sums over the jobs of time the busiest thread spent calling
+		 * the body and of average such time of all threads.
+		 */
+		double longest, average;
+
+		/**
+		 * Returns how much longer the busiest thread worked than an
+		 * average one, relative to the latter; zero means perfect
+		 * balance.
+		 */
+		double imbalance() const {
+			return average > 0 ? longest / average - 1 : 0;
+		}
+	};
+
+	const Stats &getStats() const { return stats; }
+	void resetStats();
+
+
+	/** Number of threads of the pool returned by pool(). */
+	static unsigned threads;
+	/** Largest number of threads parseThreads() accepts. */
+	static const unsigned maxThreads = 1024;
+
+	/**
+	 * Parses number of threads given by user; zero stands for number
+	 * of hardware threads.
+	 * \param str string to parse.
+	 * \param count location to save result to.
+	 * \return whether string was a number not greater then #maxThreads.
+	 */
+	static bool parseThreads(const char *str, unsigned &count);
+
+	inline static ThreadPool *pool() {
+		if (!singleton) {
+			singleton = new ThreadPool(threads);
+		}
+		return singleton;
+	}
+
+	static void destroy() {
+		delete singleton;
+		singleton = 0;
+	}
+
+
+private:
+	struct Range {
+		unsigned begin, end;
+	};
+
+	/** Ranges a thread is yet to process. */
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Range> ranges;
+		/** Time spent calling the body during current job. */
+		double seconds;
+		/** Ranges stolen during current job. */
+		unsigned long long steals;
+	};
+
+	std::vector<std::thread> workers;
+	/** One queue for each thread, calling one's is first. */
+	std::unique_ptr<Queue[]> queues;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+
+	/** Job being run and number of busy workers. */
+	const Body *body;
+	unsigned busy;
+	/** Pieces of this many elements or less are not split. */
+	unsigned grain;
+	/** Number of elements of the job not processed yet. */
+	std::atomic<unsigned> remaining;
+	/** Incremented each time a new job is started. */
+	unsigned long generation;
+	bool stop;
+	Stats stats;
+
+	void work(unsigned index);
+	void process(unsigned index);
+	bool take(unsigned index, Range &range);
+
+	ThreadPool(const ThreadPool &p) { (void)p; }
+	void operator=(const ThreadPool &p) { (void)p; }
+
+	static ThreadPool *singleton;
+};
+
+
+}
+
+}
+
+#endif
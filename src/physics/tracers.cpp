@@ -0,0 +1,149 @@
+/*
+ * src/physics/tracers.cpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "object.hpp"
+
+#include <algorithm>
+
+#include "kernel.hpp"
+#include "thread-pool.hpp"
+
+
+namespace mn {
+
+namespace physics {
+
+
+template<class T>
+unsigned BasicObjects<T>::addTracer(const Vector &position,
+                                    const Vector &velocity) {
+	tracerX.push_back(position.x);
+	tracerY.push_back(position.y);
+	tracerZ.push_back(position.z);
+	tracerVX.push_back(velocity.x);
+	tracerVY.push_back(velocity.y);
+	tracerVZ.push_back(velocity.z);
+	tracerAX.push_back(0);
+	tracerAY.push_back(0);
+	tracerAZ.push_back(0);
+	tracersValid = false;
+	return tracerX.size() - 1;
+}
+
+
+template<class T>
+void BasicObjects<T>::tracerAccelerationsAll(const value_type *sx,
+                                             const value_type *sy,
+                                             const value_type *sz) {
+	/* Chunks are big enough to fill vectors of any width. */
+	const unsigned chunk = 64;
+	const unsigned count = tracers(), chunks = (count + chunk - 1) / chunk;
+	/* Kernel is used even if objects do not use it (see addTracer())
+	 * but its options are only honoured if they do. */
+	const kernel::Isa tracerIsa = useKernel ? isa : kernel::detect();
+	const bool tracerRsqrt = useKernel && rsqrt;
+
+	ThreadPool::pool()->run(chunks, [&](unsigned begin, unsigned end) {
+		const unsigned first = begin * chunk;
+		const unsigned last = std::min(end * chunk, count);
+		kernel::accelerations(tracerIsa, tracerRsqrt, forceLaw, softening,
+		                      sx, sy, sz, mass.data(), size(),
+		                      &tracerX[first], &tracerY[first],
+		                      &tracerZ[first], last - first,
+		                      &tracerAX[first], &tracerAY[first],
+		                      &tracerAZ[first]);
+		for (unsigned k = first; k < last; ++k) {
+			tracerAX[k] *= G;
+			tracerAY[k] *= G;
+			tracerAZ[k] *= G;
+		}
+	});
+}
+
+
+template<class T>
+void BasicObjects<T>::driftTracersAll(value_type dt) {
+	if (tracerX.empty()) {
+		return;
+	}
+
+	/* With EULER accelerations at objects' current positions give the
+	 * whole kick; otherwise it is the first half of leapfrog. */
+	if (!tracersValid || integrator == EULER) {
+		tracerAccelerationsAll(x.data(), y.data(), z.data());
+	}
+
+	const value_type kick = integrator == EULER ? dt : dt / 2;
+	ThreadPool::pool()->run(tracers(), [&](unsigned begin, unsigned end) {
+		for (unsigned k = begin; k < end; ++k) {
+			tracerVX[k] += tracerAX[k] * kick;
+			tracerVY[k] += tracerAY[k] * kick;
+			tracerVZ[k] += tracerAZ[k] * kick;
+			tracerX[k] += tracerVX[k] * dt;
+			tracerY[k] += tracerVY[k] * dt;
+			tracerZ[k] += tracerVZ[k] * dt;
+		}
+	});
+	tracersValid = false;
+}
+
+
+template<class T>
+void BasicObjects<T>::kickTracersAll(value_type dt) {
+	if (tracerX.empty() || integrator == EULER) {
+		return;
+	}
+
+	/* Objects are already at the end of the tick in next arrays. */
+	tracerAccelerationsAll(nextX.data(), nextY.data(), nextZ.data());
+
+	const value_type half = dt / 2;
+	ThreadPool::pool()->run(tracers(), [&](unsigned begin, unsigned end) {
+		for (unsigned k = begin; k < end; ++k) {
+			tracerVX[k] += tracerAX[k] * half;
+			tracerVY[k] += tracerAY[k] * half;
+			tracerVZ[k] += tracerAZ[k] * half;
+		}
+	});
+	tracersValid = true;
+}
+
+
+/* Rest of BasicObjects is instantiated in object.cpp. */
+template unsigned BasicObjects<float>::addTracer(const Vector &,
+                                                 const Vector &);
+template unsigned BasicObjects<double>::addTracer(const Vector &,
+                                                  const Vector &);
+template unsigned BasicObjects<long double>::addTracer(const Vector &,
+                                                       const Vector &);
+template void BasicObjects<float>::tracerAccelerationsAll(
+	const float *, const float *, const float *);
+template void BasicObjects<double>::tracerAccelerationsAll(
+	const double *, const double *, const double *);
+template void BasicObjects<long double>::tracerAccelerationsAll(
+	const long double *, const long double *, const long double *);
+template void BasicObjects<float>::driftTracersAll(float);
+template void BasicObjects<double>::driftTracersAll(double);
+template void BasicObjects<long double>::driftTracersAll(long double);
+template void BasicObjects<float>::kickTracersAll(float);
+template void BasicObjects<double>::kickTracersAll(double);
+template void BasicObjects<long double>::kickTracersAll(long double);
+
+
+}
+
+}
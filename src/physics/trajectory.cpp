@@ -0,0 +1,260 @@
+/*
+ * src/physics/trajectory.cpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "trajectory.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "object.hpp"
+
+
+namespace mn {
+
+namespace physics {
+
+
+namespace {
+
+struct Header {
+	char magic[8];
+	uint32_t order, version, encoding, padding;
+	double quantum, velocityQuantum;
+};
+
+/**
+ * Divides value by quantum and rounds it.  Result is clamped so that
+ * difference of two results fits in 64 bits; NaN gives zero.
+ */
+int64_t quantize(double value, double quantum) {
+	const double limit = 4e18, q = value / quantum;
+	if (q != q) {
+		return 0;
+	}
+	return std::llround(std::max(-limit, std::min(limit, q)));
+}
+
+void appendVarint(std::vector<unsigned char> &data, int64_t value) {
+	uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+	for (; zigzag >= 0x80; zigzag >>= 7) {
+		data.push_back((unsigned char)(zigzag | 0x80));
+	}
+	data.push_back((unsigned char)zigzag);
+}
+
+}
+
+
+TrajectoryWriter::TrajectoryWriter(const char *filename, double dt,
+                                   double theQuantum, unsigned theChunkFrames,
+                                   unsigned maxFrames)
+	: fp(fopen(filename, "wb")), quantum(theQuantum),
+	  velocityQuantum(theQuantum / dt), chunkFrames(theChunkFrames),
+	  pool(maxFrames), stop(false), stalls(0), frames(0), bytes(0),
+	  failed(false) {
+	if (!fp) {
+		perror(filename);
+		failed = true;
+		return;
+	}
+
+	Header header;
+	memset(&header, 0, sizeof header);
+	memcpy(header.magic, "MNPHYSTR", sizeof header.magic);
+	header.order = 0x01020304;
+	header.version = 1;
+	header.encoding = quantum > 0;
+	header.quantum = quantum;
+	header.velocityQuantum = quantum > 0 ? velocityQuantum : 0;
+	write(&header, sizeof header);
+
+	for (unsigned i = 0; i < maxFrames; ++i) {
+		spare.push_back(&pool[i]);
+	}
+	thread = std::thread(&TrajectoryWriter::run, this);
+}
+
+
+template<class T>
+void TrajectoryWriter::add(const BasicObjects<T> &objects,
+                           unsigned long long tick) {
+	if (!thread.joinable()) {
+		return;
+	}
+
+	Frame *frame;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (spare.empty()) {
+			++stalls;
+			freed.wait(lock, [this]{ return !spare.empty(); });
+		}
+		frame = spare.back();
+		spare.pop_back();
+	}
+
+	const unsigned n = objects.size();
+	frame->tick = tick;
+	frame->ids.resize(n);
+	for (unsigned c = 0; c < 6; ++c) {
+		frame->values[c].resize(n);
+	}
+	for (unsigned i = 0; i < n; ++i) {
+		const typename BasicObjects<T>::Vector p = objects.getPosition(i);
+		const typename BasicObjects<T>::Vector v = objects.getVelocity(i);
+		frame->ids[i] = objects.getId(i);
+		frame->values[0][i] = p.x;
+		frame->values[1][i] = p.y;
+		frame->values[2][i] = p.z;
+		frame->values[3][i] = v.x;
+		frame->values[4][i] = v.y;
+		frame->values[5][i] = v.z;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(frame);
+	}
+	wake.notify_one();
+}
+
+
+bool TrajectoryWriter::close() {
+	if (thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		wake.notify_one();
+		thread.join();
+	}
+	if (fp) {
+		if (fclose(fp)) {
+			perror("trajectory");
+			failed = true;
+		}
+		fp = 0;
+	}
+	return !failed;
+}
+
+
+void TrajectoryWriter::run() {
+	for (;;) {
+		Frame *frame;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this]{ return stop || !queue.empty(); });
+			if (queue.empty()) {
+				break;
+			}
+			frame = queue.front();
+			queue.pop_front();
+		}
+
+		encode(*frame);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			spare.push_back(frame);
+		}
+		freed.notify_one();
+	}
+	flush();
+}
+
+
+void TrajectoryWriter::encode(const Frame &frame) {
+	if (!chunkTicks.empty() &&
+	    (chunkTicks.size() == chunkFrames || frame.ids != chunkIds)) {
+		flush();
+	}
+	const unsigned n = frame.ids.size();
+	if (chunkTicks.empty()) {
+		chunkIds = frame.ids;
+		for (unsigned c = 0; c < 6; ++c) {
+			previous[c].assign(n, 0);
+		}
+	}
+	chunkTicks.push_back(frame.tick);
+
+	for (unsigned c = 0; c < 6; ++c) {
+		const double *const values = frame.values[c].data();
+		std::vector<unsigned char> &column = columns[c];
+		if (!(quantum > 0)) {
+			const unsigned char *const ptr = (const unsigned char *)values;
+			column.insert(column.end(), ptr, ptr + n * sizeof *values);
+			continue;
+		}
+
+		const double q = c < 3 ? quantum : velocityQuantum;
+		int64_t *const prev = previous[c].data();
+		for (unsigned i = 0; i < n; ++i) {
+			const int64_t value = quantize(values[i], q);
+			appendVarint(column, value - prev[i]);
+			prev[i] = value;
+		}
+	}
+	++frames;
+}
+
+
+void TrajectoryWriter::flush() {
+	if (chunkTicks.empty()) {
+		return;
+	}
+
+	uint32_t counts[2] = { (uint32_t)chunkTicks.size(),
+	                       (uint32_t)chunkIds.size() };
+	uint64_t sizes[6];
+	for (unsigned c = 0; c < 6; ++c) {
+		sizes[c] = columns[c].size();
+	}
+	write(counts, sizeof counts);
+	write(sizes, sizeof sizes);
+	write(chunkTicks.data(), chunkTicks.size() * sizeof chunkTicks[0]);
+	write(chunkIds.data(), chunkIds.size() * sizeof chunkIds[0]);
+	for (unsigned c = 0; c < 6; ++c) {
+		write(columns[c].data(), columns[c].size());
+		columns[c].clear();
+	}
+	chunkTicks.clear();
+}
+
+
+void TrajectoryWriter::write(const void *data, size_t size) {
+	if (!failed && size && fwrite(data, 1, size, fp) != size) {
+		perror("trajectory");
+		failed = true;
+	}
+	bytes += size;
+}
+
+
+template void TrajectoryWriter::add(const BasicObjects<float> &objects,
+                                    unsigned long long tick);
+template void TrajectoryWriter::add(const BasicObjects<double> &objects,
+                                    unsigned long long tick);
+template void TrajectoryWriter::add(const BasicObjects<long double> &objects,
+                                    unsigned long long tick);
+
+
+}
+
+}
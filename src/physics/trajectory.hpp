@@ -0,0 +1,158 @@
+/*
+ * src/physics/trajectory.hpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef H_TRAJECTORY_HPP
+#define H_TRAJECTORY_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace mn {
+
+namespace physics {
+
+
+template<class T> struct BasicObjects;
+
+
+/**
+ * Writes positions and velocities of objects at chosen ticks (frames)
+ * to a file.  Frames are copied by the simulating thread and encoded
+ * and written by a background thread so simulation does not wait for
+ * the disk.  Number of frames waiting for the thread is limited; if
+ * the disk cannot keep up, simulation waits for the thread rather
+ * than memory being used without bound.
+ *
+ * File starts with a header: "MNPHYSTR", 32-bit byte order tag
+ * 0x01020304, 32-bit format version, 32-bit encoding (zero for raw
+ * doubles, one for quantized deltas), 32-bit padding and two doubles:
+ * quantum of positions and of velocities.  Chunks follow, each
+ * holding consecutive frames of the same objects:
+ * - 32-bit number of frames and number of objects,
+ * - 64-bit sizes in bytes of six columns,
+ * - 64-bit tick of each frame,
+ * - 32-bit identifier of each object (see BasicObjects::getId()),
+ * - columns of x, y, z, vx, vy and vz, each holding the component of
+ *   all objects in the first frame, then in the second and so on.
+ *
+ * With raw encoding columns are arrays of doubles.  With quantized
+ * deltas each value is divided by the quantum and rounded and the
+ * difference from the same object's value in the previous frame of
+ * the chunk (or from zero in the first frame) is written as a zigzag
+ * varint, i.e. (d << 1) ^ (d >> 63) in groups of seven bits, least
+ * significant first, with the high bit set in all but the last byte.
+ * Chunks can therefore be decoded independently.
+ */
+struct TrajectoryWriter {
+	/**
+	 * Opens file and starts the thread.
+	 * \param filename file to write trajectory to.
+	 * \param dt length of a tick; velocities are quantized to
+	 *        quantum / dt so that they err by as much as positions
+	 *        change during a tick.
+	 * \param quantum quantum of positions; if zero values are written
+	 *        as doubles.
+	 * \param chunkFrames maximal number of frames in a chunk.
+	 * \param maxFrames maximal number of frames kept in memory waiting
+	 *        for the thread.
+	 */
+	TrajectoryWriter(const char *filename, double dt, double quantum = 0,
+	                 unsigned chunkFrames = 64, unsigned maxFrames = 16);
+	/** Calls close(). */
+	~TrajectoryWriter() { close(); }
+
+	/** Returns whether file was opened and written without errors. */
+	bool good() const { return !failed; }
+
+	/**
+	 * Copies positions and velocities of objects as a frame to be
+	 * written.  Waits for the thread only if too many frames wait for
+	 * it already.
+	 */
+	template<class T>
+	void add(const BasicObjects<T> &objects, unsigned long long tick);
+
+	/**
+	 * Writes queued frames, stops the thread and closes the file.
+	 * \return whether whole trajectory was written.
+	 */
+	bool close();
+
+	/** Returns number of frames written to the file. */
+	unsigned long long getFrames() const { return frames; }
+	/** Returns number of times add() had to wait for the thread. */
+	unsigned long long getStalls() const { return stalls; }
+	/** Returns number of bytes written to the file. */
+	unsigned long long getBytes() const { return bytes; }
+
+private:
+	struct Frame {
+		unsigned long long tick;
+		std::vector<uint32_t> ids;
+		/** Components of all objects, one after another. */
+		std::vector<double> values[6];
+	};
+
+	FILE *fp;
+	const double quantum, velocityQuantum;
+	const unsigned chunkFrames;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake, freed;
+	/** Frames waiting for the thread and frames free to reuse. */
+	std::deque<Frame *> queue;
+	std::vector<Frame *> spare;
+	std::vector<Frame> pool;
+	bool stop;
+	unsigned long long stalls;
+
+	/* Following are used by the thread only. */
+	/** Ticks of frames and identifiers of objects of current chunk. */
+	std::vector<uint64_t> chunkTicks;
+	std::vector<uint32_t> chunkIds;
+	/** Encoded columns of current chunk. */
+	std::vector<unsigned char> columns[6];
+	/** Quantized values of previous frame of current chunk. */
+	std::vector<int64_t> previous[6];
+	unsigned long long frames, bytes;
+	bool failed;
+
+	void run();
+	void encode(const Frame &frame);
+	void flush();
+	void write(const void *data, size_t size);
+
+	TrajectoryWriter(const TrajectoryWriter &w)
+		: quantum(w.quantum), velocityQuantum(w.velocityQuantum),
+		  chunkFrames(w.chunkFrames) { }
+	void operator=(const TrajectoryWriter &w) { (void)w; }
+};
+
+
+}
+
+}
+
+#endif
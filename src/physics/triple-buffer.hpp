@@ -0,0 +1,78 @@
+/*
+ * src/physics/triple-buffer.hpp
+ * Copyright 2009 by Michal Nazarewicz (mina86/AT/mina86/DOT/com)
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef H_TRIPLE_BUFFER_HPP
+#define H_TRIPLE_BUFFER_HPP
+
+#include <atomic>
+
+
+namespace mn {
+
+namespace physics {
+
+
+/**
+ * A lock-free triple buffer passing values from a single writer to
+ * a single reader.  Writer fills its own buffer and publishes it by
+ * swapping it with the middle one; reader takes the middle buffer if
+ * it holds a value it has not seen yet.  Neither side ever waits for
+ * the other and reader always gets the latest published value.
+ */
+template<class T>
+struct TripleBuffer {
+	TripleBuffer() : back(0), front(1), middle(2) { }
+
+	/** Returns buffer writer may fill. */
+	T &writeBuffer() { return buffers[back]; }
+
+	/** Makes buffer returned by writeBuffer() available to reader. */
+	void publish() {
+		back = middle.exchange(back | fresh, std::memory_order_acq_rel) &
+			~fresh;
+	}
+
+	/**
+	 * Returns the latest published value.  Returned reference stays
+	 * valid until next call to read().
+	 */
+	const T &read() {
+		if (middle.load(std::memory_order_relaxed) & fresh) {
+			front = middle.exchange(front, std::memory_order_acq_rel) &
+				~fresh;
+		}
+		return buffers[front];
+	}
+
+private:
+	/** Flag set in middle if it was published but not read yet. */
+	static const unsigned fresh = 4;
+
+	T buffers[3];
+	unsigned back, front;
+	std::atomic<unsigned> middle;
+
+	TripleBuffer(const TripleBuffer &b) { (void)b; }
+	void operator=(const TripleBuffer &b) { (void)b; }
+};
+
+
+}
+
+}
+
+#endif